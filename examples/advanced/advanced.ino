@@ -124,6 +124,9 @@ void setup() {
     // Add an open network
     jw.addNetwork("work");
 
+    // Add a network that does not broadcast its SSID
+    jw.addNetwork("garage", "password", NULL, NULL, NULL, NULL, false, NULL, NULL, true);
+
     // -------------------------------------------------------------------------
 
     Serial.println("[WIFI] Connecting Wifi...");
@@ -162,4 +162,10 @@ void infoCallback(justwifi_messages_t code, char * parameter) {
         Serial.printf("[WIFI] Smart Config failed\n");
     }
 
+    // ------------------------------------------------------------------------
+
+    if (code == MESSAGE_ROAMING) {
+        Serial.printf("[WIFI] Roaming to %s\n", parameter);
+    }
+
 };
@@ -0,0 +1,421 @@
+/*
+
+JustWifi - Simulated radio backend
+
+A JustWifiRadio implementation that does not touch the real WiFi stack.
+It models scan duration, per-BSSID RSSI, authentication failures, DHCP delay
+and access point outages on top of a virtual clock that only moves forward
+when advance() is called.
+
+Copyright (C) 2016-2018 by Xose Pérez <xose dot perez at gmail dot com>
+
+The JustWifi library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The JustWifi library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the JustWifi library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef SimRadio_h
+#define SimRadio_h
+
+#include <JustWifiRadio.h>
+#include <JustWifiPMK.h>
+
+#define SIM_MAX_APS             64
+#define SIM_RTC_SIZE            512
+
+typedef struct {
+    const char * ssid;
+    const char * pass;          // NULL for open networks
+    uint8_t bssid[6];
+    uint8_t channel;
+    int8_t rssi;
+    unsigned long down_from;    // outage window [down_from, down_to)
+    unsigned long down_to;
+    bool hidden;                // SSID only revealed to directed probes
+    uint8_t fail_ratio;         // percent of attempts this AP rejects
+    bool stall;                 // rejected attempts hang instead of failing
+    bool wep;                   // pass is a WEP key, no PSK
+} sim_ap_t;
+
+// RF environment shared by a fleet of simulated radios, access points
+// reject associations over their capacity like an overloaded AP would
+typedef struct {
+    uint16_t capacity;          // associations per second, 0 for no limit
+    uint16_t * load;            // association requests per second
+    size_t size;
+} sim_air_t;
+
+class SimRadio : public JustWifiRadio {
+
+    public:
+
+        // Timing model (ms)
+        unsigned long scan_time = 2100;
+        unsigned long channel_scan_time = 120;
+        unsigned long assoc_time = 300;
+        unsigned long dhcp_time = 400;
+        unsigned long fail_time = 1500;
+
+        // Noise model
+        uint8_t rssi_jitter = 4;
+        uint8_t auth_fail_ratio = 0;    // percent of attempts that fail randomly
+
+        // Counters
+        unsigned int scans = 0;
+        unsigned long scan_airtime = 0;     // ms spent scanning
+        unsigned int attempts = 0;
+        unsigned int polls = 0;         // status() calls
+        unsigned int order_errors = 0;  // events fired out of order
+
+        sim_air_t * air = NULL;
+
+        void reset(uint32_t seed) {
+            _now = 0;
+            _seed = seed ? seed : 1;
+            _chip_id = seed & 0xFFFFFF;
+            _mode = WIFI_OFF;
+            _status = WL_DISCONNECTED;
+            _target = -1;
+            _pending = false;
+            _static_ip = false;
+            _scan_start = 0;
+            _scan_count = WIFI_SCAN_FAILED;
+            _scanning = false;
+            _associated = false;
+            _callback = NULL;
+            scans = 0;
+            scan_airtime = 0;
+            attempts = 0;
+            polls = 0;
+            order_errors = 0;
+            for (uint8_t i = 0; i < _ap_count; i++) _rssi[i] = _aps[i].rssi;
+        }
+
+        void setAccessPoints(const sim_ap_t * aps, uint8_t count) {
+            _aps = aps;
+            _ap_count = count < SIM_MAX_APS ? count : SIM_MAX_APS;
+            for (uint8_t i = 0; i < _ap_count; i++) _rssi[i] = _aps[i].rssi;
+        }
+
+        // Moves the station relative to an access point, until the next reset()
+        void setRSSI(uint8_t index, int8_t rssi) {
+            if (index < _ap_count) _rssi[index] = rssi;
+        }
+
+        // Events fire as soon as the state changes
+        void advance(unsigned long ms) {
+            _now += ms;
+            if (_callback) _update();
+        }
+
+        // ---------------------------------------------------------------------
+
+        unsigned long millis() { return _now; }
+        void delay(unsigned long ms) { _now += ms; }
+        uint32_t chipId() { return _chip_id; }
+        const char * sdkVersion() { return "sim"; }
+
+        // RTC memory survives reset(), like it does a deep sleep
+        bool rtcRead(uint32_t offset, uint32_t * data, size_t size) {
+            if (offset * 4 + size > SIM_RTC_SIZE) return false;
+            memcpy(data, &_rtc[offset], size);
+            return true;
+        }
+        bool rtcWrite(uint32_t offset, uint32_t * data, size_t size) {
+            if (offset * 4 + size > SIM_RTC_SIZE) return false;
+            memcpy(&_rtc[offset], data, size);
+            return true;
+        }
+
+        WiFiMode_t getMode() { return _mode; }
+        bool mode(WiFiMode_t mode) { _mode = mode; return true; }
+        bool enableSTA(bool enabled) {
+            _mode = (WiFiMode_t) (enabled ? (_mode | WIFI_STA) : (_mode & ~WIFI_STA));
+            if (!enabled) {
+                _target = -1;
+                _pending = false;
+            }
+            return true;
+        }
+        bool enableAP(bool enabled) {
+            _mode = (WiFiMode_t) (enabled ? (_mode | WIFI_AP) : (_mode & ~WIFI_AP));
+            return true;
+        }
+        void persistent(bool persistent) {}
+        bool forceSleepBegin() { return true; }
+        bool forceSleepWake() { return true; }
+
+        bool hostname(const char * hostname) { return true; }
+        bool config(IPAddress ip, IPAddress gw, IPAddress netmask, IPAddress dns) {
+            _static_ip = ((uint32_t) ip != 0);
+            return true;
+        }
+
+        wl_status_t begin(const char * ssid, const char * pass, int32_t channel = 0, const uint8_t * bssid = NULL) {
+
+            attempts++;
+            _begin = _now;
+            _pending = true;
+            _target = -1;
+            _auth_ok = false;
+            _stalled = false;
+            _associated = false;
+
+            // Pick the AP the stack would associate to
+            int8_t best = -127;
+            for (uint8_t i = 0; i < _ap_count; i++) {
+                const sim_ap_t * ap = &_aps[i];
+                if (!_up(ap)) continue;
+                if (strcmp(ap->ssid, ssid) != 0) continue;
+                if (channel && (ap->channel != channel)) continue;
+                if (bssid && (memcmp(ap->bssid, bssid, 6) != 0)) continue;
+                if (_rssi[i] > best) {
+                    best = _rssi[i];
+                    _target = i;
+                }
+            }
+
+            if (_target >= 0) {
+                const sim_ap_t * ap = &_aps[_target];
+                bool pass_ok = _authenticate(ap, pass);
+                bool flaky = ap->fail_ratio && (_random() % 100 < ap->fail_ratio);
+                _auth_ok = pass_ok && !flaky && (_random() % 100 >= auth_fail_ratio) && _admit();
+                _stalled = flaky && ap->stall;
+            }
+
+            _status = WL_DISCONNECTED;
+            return _status;
+
+        }
+
+        bool disconnect() {
+            bool associated = _associated;
+            _target = -1;
+            _pending = false;
+            _associated = false;
+            _status = WL_DISCONNECTED;
+            if (associated) _notify(RADIO_EVENT_DISCONNECTED);
+            return true;
+        }
+
+        // Last known status, without counting it as a poll
+        wl_status_t peek() {
+            return _status;
+        }
+
+        wl_status_t status() {
+            polls++;
+            _update();
+            return _status;
+        }
+
+        bool setAutoConnect(bool autoConnect) { return true; }
+        bool setAutoReconnect(bool autoReconnect) { return true; }
+        String SSID() { return String(_target >= 0 ? _aps[_target].ssid : ""); }
+        String psk() { return String(_target >= 0 && _aps[_target].pass ? _aps[_target].pass : ""); }
+        uint8_t * BSSID() { return _target >= 0 ? (uint8_t *) _aps[_target].bssid : NULL; }
+        int32_t channel() { return _target >= 0 ? _aps[_target].channel : 0; }
+        int32_t RSSI() { return (WL_CONNECTED == _status) ? _rssi[_target] + _jitter() : 31; }
+        IPAddress localIP() { return IPAddress(192, 168, 1, 100 + _target); }
+        IPAddress gatewayIP() { return IPAddress(192, 168, 1, 1); }
+        IPAddress subnetMask() { return IPAddress(255, 255, 255, 0); }
+        IPAddress dnsIP() { return IPAddress(192, 168, 1, 1); }
+
+        // ---------------------------------------------------------------------
+
+        int8_t scanNetworks(bool async, bool show_hidden, uint8_t channel = 0, const char * ssid = NULL) {
+            scans++;
+            _scanning = true;
+            _scan_start = _now;
+            _scan_channel = channel;
+            _scan_ssid = ssid;
+            _scan_count = WIFI_SCAN_RUNNING;
+            return WIFI_SCAN_RUNNING;
+        }
+
+        int8_t scanComplete() {
+            unsigned long duration = _scan_channel ? channel_scan_time : scan_time;
+            if (_scanning && (_now - _scan_start >= duration)) {
+                _scanning = false;
+                scan_airtime += duration;
+                _snapshot();
+            }
+            return _scan_count;
+        }
+
+        void scanDelete() {
+            _scan_count = WIFI_SCAN_FAILED;
+        }
+
+        bool getScanResult(uint8_t i, justwifi_scan_result_t &result) {
+            if ((_scan_count < 0) || (i >= _scan_count)) return false;
+            const sim_ap_t * ap = &_aps[_results[i]];
+            result.ssid = (const uint8_t *) ap->ssid;
+            result.ssid_len = (ap->hidden && !_scan_ssid) ? 0 : strlen(ap->ssid);
+            result.bssid = ap->bssid;
+            result.rssi = _result_rssi[i];
+            result.channel = ap->channel;
+            result.security = ap->pass ? (ap->wep ? ENC_TYPE_WEP : ENC_TYPE_CCMP) : ENC_TYPE_NONE;
+            result.hidden = ap->hidden;
+            return true;
+        }
+
+        // ---------------------------------------------------------------------
+
+        bool softAP(const char * ssid, const char * pass = NULL) { return true; }
+        bool softAPConfig(IPAddress ip, IPAddress gw, IPAddress netmask) { return true; }
+        bool softAPdisconnect() { return true; }
+
+        bool beginSmartConfig() { return false; }
+        bool smartConfigDone() { return false; }
+        bool stopSmartConfig() { return true; }
+
+        bool onEvent(justwifi_radio_callback_t callback, void * context) {
+            _callback = callback;
+            _context = context;
+            return true;
+        }
+
+    private:
+
+        const sim_ap_t * _aps = NULL;
+        uint8_t _ap_count = 0;
+        int8_t _rssi[SIM_MAX_APS];
+
+        unsigned long _now = 0;
+        uint32_t _seed = 1;
+        uint32_t _chip_id = 1;
+        uint32_t _rtc[SIM_RTC_SIZE / 4] = {0};
+        WiFiMode_t _mode = WIFI_OFF;
+
+        wl_status_t _status = WL_DISCONNECTED;
+        int16_t _target = -1;
+        bool _pending = false;
+        bool _auth_ok = false;
+        bool _stalled = false;
+        bool _static_ip = false;
+        unsigned long _begin = 0;
+        bool _associated = false;
+
+        justwifi_radio_callback_t _callback = NULL;
+        void * _context = NULL;
+        int8_t _last_event = -1;
+
+        bool _scanning = false;
+        unsigned long _scan_start = 0;
+        uint8_t _scan_channel = 0;
+        const char * _scan_ssid = NULL;
+        int8_t _scan_count = WIFI_SCAN_FAILED;
+        uint8_t _results[SIM_MAX_APS];
+        int8_t _result_rssi[SIM_MAX_APS];
+
+        // Accepts either the passphrase or the PSK as 64 hex digits
+        bool _authenticate(const sim_ap_t * ap, const char * pass) {
+            if (NULL == ap->pass) return true;
+            if (NULL == pass) return false;
+            if (ap->wep || (strlen(pass) != 2 * JUSTWIFI_PMK_SIZE)) return (strcmp(ap->pass, pass) == 0);
+            uint8_t pmk[JUSTWIFI_PMK_SIZE];
+            char psk[2 * JUSTWIFI_PMK_SIZE + 1];
+            // Same as JustWifiPMK::compute, but letting the board breathe
+            JustWifiPMK job;
+            job.begin(ap->pass, (const uint8_t *) ap->ssid, strlen(ap->ssid));
+            while (!job.step(256)) yield();
+            job.get(pmk);
+            for (uint8_t i = 0; i < JUSTWIFI_PMK_SIZE; i++) {
+                snprintf(&psk[2*i], 3, "%02x", pmk[i]);
+            }
+            return (strcasecmp(psk, pass) == 0);
+        }
+
+        void _notify(justwifi_radio_event_t event) {
+            // GOT_IP always comes right after CONNECTED
+            if ((RADIO_EVENT_GOT_IP == event) && (RADIO_EVENT_CONNECTED != _last_event)) order_errors++;
+            _last_event = event;
+            if (_callback) _callback(event, _context);
+        }
+
+        void _update() {
+
+            wl_status_t previous = _status;
+
+            if (_target < 0) {
+                if (_pending && (_now - _begin > fail_time)) {
+                    _status = WL_NO_SSID_AVAIL;
+                }
+
+            // AP went away
+            } else if (!_up(&_aps[_target])) {
+                _target = -1;
+                _status = WL_NO_SSID_AVAIL;
+
+            } else if (!_auth_ok) {
+                if (!_stalled && (_now - _begin > fail_time)) _status = WL_CONNECT_FAILED;
+
+            } else {
+                if (!_associated && (_now - _begin >= assoc_time)) {
+                    _associated = true;
+                    _notify(RADIO_EVENT_CONNECTED);
+                }
+                unsigned long ready = assoc_time + (_static_ip ? 0 : dhcp_time);
+                if (_now - _begin >= ready) _status = WL_CONNECTED;
+            }
+
+            if (_status == previous) return;
+            if (WL_CONNECTED == _status) {
+                _notify(RADIO_EVENT_GOT_IP);
+            } else if ((WL_NO_SSID_AVAIL == _status) || (WL_CONNECT_FAILED == _status)) {
+                _associated = false;
+                _notify(RADIO_EVENT_DISCONNECTED);
+            }
+
+        }
+
+        bool _admit() {
+            if (!air) return true;
+            size_t second = _now / 1000;
+            if (second >= air->size) return true;
+            if (air->load[second] < 0xFFFF) air->load[second]++;
+            return (0 == air->capacity) || (air->load[second] <= air->capacity);
+        }
+
+        bool _up(const sim_ap_t * ap) {
+            return (_now < ap->down_from) || (_now >= ap->down_to);
+        }
+
+        int8_t _jitter() {
+            return rssi_jitter ? (int8_t) (_random() % (2 * rssi_jitter + 1)) - rssi_jitter : 0;
+        }
+
+        uint32_t _random() {
+            // xorshift32
+            _seed ^= _seed << 13;
+            _seed ^= _seed >> 17;
+            _seed ^= _seed << 5;
+            return _seed;
+        }
+
+        void _snapshot() {
+            _scan_count = 0;
+            for (uint8_t i = 0; i < _ap_count && _scan_count < SIM_MAX_APS; i++) {
+                if (!_up(&_aps[i])) continue;
+                if (_scan_channel && (_aps[i].channel != _scan_channel)) continue;
+                if (_scan_ssid && (strcmp(_aps[i].ssid, _scan_ssid) != 0)) continue;
+                _results[_scan_count] = i;
+                _result_rssi[_scan_count] = _rssi[i] + _jitter();
+                _scan_count++;
+            }
+        }
+
+};
+
+#endif
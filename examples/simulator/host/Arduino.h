@@ -0,0 +1,153 @@
+/*
+
+JustWifi - Simulator host build
+
+Just enough of the Arduino core to build the library and the simulator
+example natively. Nothing here talks to a radio, the simulator plugs its
+own backend (SimRadio) into JustWifi.
+
+Copyright (C) 2016-2018 by Xose Pérez <xose dot perez at gmail dot com>
+
+The JustWifi library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The JustWifi library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the JustWifi library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <string>
+#include <functional>
+#include <memory>
+
+#define PROGMEM
+#define PSTR(s)                 (s)
+#define F(s)                    (s)
+#define snprintf_P              snprintf
+#define sprintf_P               sprintf
+#define strcmp_P                strcmp
+#define strncmp_P               strncmp
+#define strlen_P                strlen
+#define memcpy_P                memcpy
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+typedef uint8_t uint8;
+typedef int8_t sint8;
+typedef uint16_t uint16;
+typedef int16_t sint16;
+typedef uint32_t uint32;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+class String {
+
+    public:
+
+        String() {}
+        String(const char * value) : _value(value ? value : "") {}
+        String(int value) : _value(std::to_string(value)) {}
+
+        const char * c_str() const { return _value.c_str(); }
+        unsigned int length() const { return _value.size(); }
+        bool equals(const char * other) const { return _value == other; }
+        bool equals(const String & other) const { return _value == other._value; }
+        String & operator=(const char * value) { _value = value ? value : ""; return *this; }
+
+    private:
+
+        std::string _value;
+
+};
+
+class Print {
+
+    public:
+
+        virtual ~Print() {}
+        virtual size_t write(uint8_t c) = 0;
+        virtual size_t write(const uint8_t * buffer, size_t size) {
+            size_t n = 0;
+            while ((n < size) && write(buffer[n])) n++;
+            return n;
+        }
+
+        size_t printf(const char * format, ...) {
+            char buffer[256];
+            va_list args;
+            va_start(args, format);
+            int length = vsnprintf(buffer, sizeof(buffer), format, args);
+            va_end(args);
+            if (length < 0) return 0;
+            if (length >= (int) sizeof(buffer)) length = sizeof(buffer) - 1;
+            return write((const uint8_t *) buffer, length);
+        }
+        size_t println(const char * value = "") {
+            size_t n = write((const uint8_t *) value, strlen(value));
+            return n + write('\n');
+        }
+
+};
+
+class Stream : public Print {
+
+    public:
+
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() = 0;
+        virtual void flush() {}
+
+        size_t readBytes(uint8_t * buffer, size_t length) {
+            size_t n = 0;
+            while (n < length) {
+                int c = read();
+                if (c < 0) break;
+                buffer[n++] = c;
+            }
+            return n;
+        }
+        size_t readBytes(char * buffer, size_t length) {
+            return readBytes((uint8_t *) buffer, length);
+        }
+
+};
+
+// Goes to stdout
+class HardwareSerial : public Stream {
+
+    public:
+
+        void begin(unsigned long baud) {}
+        size_t write(uint8_t c) { return fwrite(&c, 1, 1, stdout); }
+        size_t write(const uint8_t * buffer, size_t size) { return fwrite(buffer, 1, size, stdout); }
+        int available() { return 0; }
+        int read() { return -1; }
+        int peek() { return -1; }
+        void flush() { fflush(stdout); }
+
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,150 @@
+/*
+
+JustWifi - Simulator host build
+
+Copyright (C) 2016-2018 by Xose Pérez <xose dot perez at gmail dot com>
+
+The JustWifi library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The JustWifi library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the JustWifi library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef ESP8266WiFi_h
+#define ESP8266WiFi_h
+
+#include "Arduino.h"
+#include "IPAddress.h"
+#include "user_interface.h"
+
+typedef enum {
+    WL_NO_SHIELD = 255,
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL,
+    WL_SCAN_COMPLETED,
+    WL_CONNECTED,
+    WL_CONNECT_FAILED,
+    WL_CONNECTION_LOST,
+    WL_DISCONNECTED
+} wl_status_t;
+
+typedef enum {
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} WiFiMode_t;
+
+enum {
+    ENC_TYPE_WEP = 5,
+    ENC_TYPE_TKIP = 2,
+    ENC_TYPE_CCMP = 4,
+    ENC_TYPE_NONE = 7,
+    ENC_TYPE_AUTO = 8
+};
+
+#define WIFI_SCAN_RUNNING       (-1)
+#define WIFI_SCAN_FAILED        (-2)
+
+struct WiFiEventStationModeConnected {
+    String ssid;
+    uint8 bssid[6];
+    uint8 channel;
+};
+
+struct WiFiEventStationModeDisconnected {
+    String ssid;
+    uint8 bssid[6];
+    uint8 reason;
+};
+
+struct WiFiEventStationModeGotIP {
+    IPAddress ip;
+    IPAddress mask;
+    IPAddress gw;
+};
+
+struct WiFiEventHandlerOpaque {};
+typedef std::shared_ptr<WiFiEventHandlerOpaque> WiFiEventHandler;
+
+class ESP8266WiFiScanClass {
+    protected:
+        static void * _getScanInfoByIndex(int i);
+};
+
+// The default backend (JustWifiESP8266Radio) has to link, but the
+// simulator never uses it: there is no radio, nothing ever connects
+class ESP8266WiFiClass : public ESP8266WiFiScanClass {
+
+    public:
+
+        WiFiMode_t getMode();
+        bool mode(WiFiMode_t mode);
+        bool enableSTA(bool enabled);
+        bool enableAP(bool enabled);
+        void persistent(bool persistent);
+        bool forceSleepBegin(uint32 us = 0);
+        bool forceSleepWake();
+
+        wl_status_t begin(const char * ssid, const char * pass = NULL, int32_t channel = 0, const uint8_t * bssid = NULL, bool connect = true);
+        bool config(IPAddress ip, IPAddress gw, IPAddress netmask, IPAddress dns1 = (uint32_t) 0, IPAddress dns2 = (uint32_t) 0);
+        bool disconnect(bool wifioff = false);
+        wl_status_t status();
+        bool setAutoConnect(bool autoConnect);
+        bool setAutoReconnect(bool autoReconnect);
+        String SSID() const;
+        String psk() const;
+        uint8_t * BSSID();
+        int32_t channel();
+        int32_t RSSI();
+        bool hostname(const char * hostname);
+        IPAddress localIP();
+        IPAddress gatewayIP();
+        IPAddress subnetMask();
+        IPAddress dnsIP(uint8_t index = 0);
+
+        int8_t scanNetworks(bool async = false, bool show_hidden = false, uint8 channel = 0, uint8 * ssid = NULL);
+        int8_t scanComplete();
+        void scanDelete();
+
+        bool softAP(const char * ssid, const char * pass = NULL, int channel = 1, int hidden = 0, int max = 4);
+        bool softAPConfig(IPAddress ip, IPAddress gw, IPAddress netmask);
+        bool softAPdisconnect(bool wifioff = false);
+        IPAddress softAPIP();
+
+        bool beginSmartConfig();
+        bool stopSmartConfig();
+        bool smartConfigDone();
+
+        WiFiEventHandler onStationModeConnected(std::function<void(const WiFiEventStationModeConnected &)> callback);
+        WiFiEventHandler onStationModeDisconnected(std::function<void(const WiFiEventStationModeDisconnected &)> callback);
+        WiFiEventHandler onStationModeGotIP(std::function<void(const WiFiEventStationModeGotIP &)> callback);
+
+};
+
+extern ESP8266WiFiClass WiFi;
+
+class EspClass {
+
+    public:
+
+        uint32_t getChipId();
+        const char * getSdkVersion();
+        uint32_t getFreeHeap();
+        bool rtcUserMemoryRead(uint32_t offset, uint32_t * data, size_t size);
+        bool rtcUserMemoryWrite(uint32_t offset, uint32_t * data, size_t size);
+
+};
+
+extern EspClass ESP;
+
+#endif
@@ -0,0 +1,65 @@
+/*
+
+JustWifi - Simulator host build
+
+Copyright (C) 2016-2018 by Xose Pérez <xose dot perez at gmail dot com>
+
+The JustWifi library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The JustWifi library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the JustWifi library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef IPAddress_h
+#define IPAddress_h
+
+#include "Arduino.h"
+
+class IPAddress {
+
+    public:
+
+        IPAddress() { _address.dword = 0; }
+        IPAddress(uint32_t address) { _address.dword = address; }
+        IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+            _address.bytes[0] = a;
+            _address.bytes[1] = b;
+            _address.bytes[2] = c;
+            _address.bytes[3] = d;
+        }
+
+        operator uint32_t() const { return _address.dword; }
+        uint8_t operator[](int index) const { return _address.bytes[index]; }
+
+        bool fromString(const char * address) {
+            unsigned int a, b, c, d;
+            if (sscanf(address, "%u.%u.%u.%u", &a, &b, &c, &d) != 4) return false;
+            *this = IPAddress(a, b, c, d);
+            return true;
+        }
+        String toString() const {
+            char buffer[16];
+            snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u",
+                _address.bytes[0], _address.bytes[1], _address.bytes[2], _address.bytes[3]);
+            return String(buffer);
+        }
+
+    private:
+
+        union {
+            uint8_t bytes[4];
+            uint32_t dword;
+        } _address;
+
+};
+
+#endif
@@ -0,0 +1,2 @@
+// JustWifi - Simulator host build, the core the shim mimics
+#define ARDUINO_ESP8266_RELEASE_2_4_2
@@ -0,0 +1,203 @@
+/*
+
+JustWifi - Simulator host build
+
+Runs the simulator sketch natively: setup() once, the exit code is the
+number of failed checks so it can gate a build. See the Makefile.
+
+Copyright (C) 2016-2018 by Xose Pérez <xose dot perez at gmail dot com>
+
+The JustWifi library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The JustWifi library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the JustWifi library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <chrono>
+#include <new>
+#include "ESP8266WiFi.h"
+
+HardwareSerial Serial;
+ESP8266WiFiClass WiFi;
+EspClass ESP;
+
+// -----------------------------------------------------------------------------
+// System
+// -----------------------------------------------------------------------------
+
+static unsigned long _host_millis = 0;
+
+unsigned long millis() {
+    return _host_millis;
+}
+
+// Wall clock, only used to time the library code
+unsigned long micros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+void delay(unsigned long ms) {
+    _host_millis += ms;
+}
+
+void yield() {}
+
+uint32_t EspClass::getChipId() { return 0x00C0FFEE; }
+const char * EspClass::getSdkVersion() { return "host"; }
+uint32_t EspClass::getFreeHeap() { return 0; }
+
+static uint32_t _host_rtc[128];
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t * data, size_t size) {
+    if (offset * 4 + size > sizeof(_host_rtc)) return false;
+    memcpy(data, &_host_rtc[offset], size);
+    return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t * data, size_t size) {
+    if (offset * 4 + size > sizeof(_host_rtc)) return false;
+    memcpy(&_host_rtc[offset], data, size);
+    return true;
+}
+
+bool wifi_wps_disable() { return true; }
+bool wifi_wps_enable(int type) { return false; }
+bool wifi_set_wps_cb(wps_st_cb_t callback) { return false; }
+bool wifi_wps_start() { return false; }
+
+// -----------------------------------------------------------------------------
+// WiFi, a radio that never finds or connects to anything
+// -----------------------------------------------------------------------------
+
+void * ESP8266WiFiScanClass::_getScanInfoByIndex(int i) { return NULL; }
+
+WiFiMode_t ESP8266WiFiClass::getMode() { return WIFI_OFF; }
+bool ESP8266WiFiClass::mode(WiFiMode_t mode) { return true; }
+bool ESP8266WiFiClass::enableSTA(bool enabled) { return true; }
+bool ESP8266WiFiClass::enableAP(bool enabled) { return true; }
+void ESP8266WiFiClass::persistent(bool persistent) {}
+bool ESP8266WiFiClass::forceSleepBegin(uint32 us) { return true; }
+bool ESP8266WiFiClass::forceSleepWake() { return true; }
+
+wl_status_t ESP8266WiFiClass::begin(const char * ssid, const char * pass, int32_t channel, const uint8_t * bssid, bool connect) { return WL_DISCONNECTED; }
+bool ESP8266WiFiClass::config(IPAddress ip, IPAddress gw, IPAddress netmask, IPAddress dns1, IPAddress dns2) { return true; }
+bool ESP8266WiFiClass::disconnect(bool wifioff) { return true; }
+wl_status_t ESP8266WiFiClass::status() { return WL_DISCONNECTED; }
+bool ESP8266WiFiClass::setAutoConnect(bool autoConnect) { return true; }
+bool ESP8266WiFiClass::setAutoReconnect(bool autoReconnect) { return true; }
+String ESP8266WiFiClass::SSID() const { return String(); }
+String ESP8266WiFiClass::psk() const { return String(); }
+uint8_t * ESP8266WiFiClass::BSSID() { static uint8_t bssid[6]; return bssid; }
+int32_t ESP8266WiFiClass::channel() { return 0; }
+int32_t ESP8266WiFiClass::RSSI() { return 31; }
+bool ESP8266WiFiClass::hostname(const char * hostname) { return true; }
+IPAddress ESP8266WiFiClass::localIP() { return IPAddress(); }
+IPAddress ESP8266WiFiClass::gatewayIP() { return IPAddress(); }
+IPAddress ESP8266WiFiClass::subnetMask() { return IPAddress(); }
+IPAddress ESP8266WiFiClass::dnsIP(uint8_t index) { return IPAddress(); }
+
+int8_t ESP8266WiFiClass::scanNetworks(bool async, bool show_hidden, uint8 channel, uint8 * ssid) { return WIFI_SCAN_FAILED; }
+int8_t ESP8266WiFiClass::scanComplete() { return WIFI_SCAN_FAILED; }
+void ESP8266WiFiClass::scanDelete() {}
+
+bool ESP8266WiFiClass::softAP(const char * ssid, const char * pass, int channel, int hidden, int max) { return true; }
+bool ESP8266WiFiClass::softAPConfig(IPAddress ip, IPAddress gw, IPAddress netmask) { return true; }
+bool ESP8266WiFiClass::softAPdisconnect(bool wifioff) { return true; }
+IPAddress ESP8266WiFiClass::softAPIP() { return IPAddress(); }
+
+bool ESP8266WiFiClass::beginSmartConfig() { return false; }
+bool ESP8266WiFiClass::stopSmartConfig() { return true; }
+bool ESP8266WiFiClass::smartConfigDone() { return false; }
+
+WiFiEventHandler ESP8266WiFiClass::onStationModeConnected(std::function<void(const WiFiEventStationModeConnected &)> callback) { return WiFiEventHandler(); }
+WiFiEventHandler ESP8266WiFiClass::onStationModeDisconnected(std::function<void(const WiFiEventStationModeDisconnected &)> callback) { return WiFiEventHandler(); }
+WiFiEventHandler ESP8266WiFiClass::onStationModeGotIP(std::function<void(const WiFiEventStationModeGotIP &)> callback) { return WiFiEventHandler(); }
+
+// -----------------------------------------------------------------------------
+// Sketch
+// -----------------------------------------------------------------------------
+
+// Heap allocations so far, see allocRun()
+#define SIM_COUNT_ALLOCATIONS
+unsigned long sim_allocations = 0;
+
+#include "../simulator.ino"
+
+#if defined(__GLIBC__)
+
+// Counted at the C level so strdup and friends show up too
+extern "C" {
+
+void * __libc_malloc(size_t size);
+void * __libc_calloc(size_t count, size_t size);
+void * __libc_realloc(void * p, size_t size);
+void __libc_free(void * p);
+
+void * malloc(size_t size) {
+    sim_allocations++;
+    return __libc_malloc(size);
+}
+
+void * calloc(size_t count, size_t size) {
+    sim_allocations++;
+    return __libc_calloc(count, size);
+}
+
+void * realloc(void * p, size_t size) {
+    sim_allocations++;
+    return __libc_realloc(p, size);
+}
+
+void free(void * p) {
+    __libc_free(p);
+}
+
+}
+
+#else
+
+void * operator new(size_t size) {
+    sim_allocations++;
+    void * p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void * operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void * p) noexcept {
+    free(p);
+}
+
+void operator delete[](void * p) noexcept {
+    free(p);
+}
+
+void operator delete(void * p, size_t size) noexcept {
+    free(p);
+}
+
+void operator delete[](void * p, size_t size) noexcept {
+    free(p);
+}
+
+#endif
+
+int main() {
+    setup();
+    fflush(stdout);
+    return (sim_failed_checks > 255) ? 255 : sim_failed_checks;
+}
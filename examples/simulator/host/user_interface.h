@@ -0,0 +1,62 @@
+/*
+
+JustWifi - Simulator host build
+
+Copyright (C) 2016-2018 by Xose Pérez <xose dot perez at gmail dot com>
+
+The JustWifi library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The JustWifi library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the JustWifi library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef user_interface_h
+#define user_interface_h
+
+#include "Arduino.h"
+
+typedef enum {
+    AUTH_OPEN = 0,
+    AUTH_WEP,
+    AUTH_WPA_PSK,
+    AUTH_WPA2_PSK,
+    AUTH_WPA_WPA2_PSK,
+    AUTH_MAX
+} AUTH_MODE;
+
+struct bss_info {
+    uint8 bssid[6];
+    uint8 ssid[32];
+    uint8 ssid_len;
+    uint8 channel;
+    sint8 rssi;
+    AUTH_MODE authmode;
+    uint8 is_hidden;
+};
+
+typedef enum {
+    WPS_CB_ST_SUCCESS = 0,
+    WPS_CB_ST_FAILED,
+    WPS_CB_ST_TIMEOUT,
+    WPS_CB_ST_WEP
+} wps_cb_status;
+
+typedef void (*wps_st_cb_t)(int status);
+
+#define WPS_TYPE_PBC            1
+
+bool wifi_wps_disable();
+bool wifi_wps_enable(int type);
+bool wifi_set_wps_cb(wps_st_cb_t callback);
+bool wifi_wps_start();
+
+#endif
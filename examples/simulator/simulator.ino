@@ -0,0 +1,1294 @@
+/*
+
+JustWifi - Simulator example
+
+This example does not use the radio at all. It plugs a simulated backend
+(see SimRadio.h) into a JustWifi instance, replays a few scripted scenarios
+against a virtual clock and reports time-to-connect percentiles, number of
+scans and number of failed attempts for each of them. It also checks the
+network list export survives a round trip and rejects corrupted images.
+
+It runs on the board, with a small fleet for the reconnect storm, or
+natively through the host build in the host folder (see the Makefile
+there), which also turns any failed check into a failed run.
+
+Copyright (C) 2016-2018 by Xose Pérez <xose dot perez at gmail dot com>
+
+The JustWifi library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The JustWifi library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the JustWifi library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <JustWifi.h>
+#include <algorithm>
+#include "SimRadio.h"
+
+#define TRIALS                  50
+#define TICK                    10
+#define TRIAL_LIMIT             300000
+
+// The fleet has to fit in RAM, a thousand devices is for the host build
+#ifndef STORM_DEVICES
+#if defined(ESP8266)
+#define STORM_DEVICES           20
+#else
+#define STORM_DEVICES           1000
+#endif
+#endif
+#define STORM_CAPACITY          ((STORM_DEVICES + 19) / 20)
+#define STORM_TICK              50
+#define STORM_LIMIT             600
+
+// -----------------------------------------------------------------------------
+// Scenarios
+// -----------------------------------------------------------------------------
+
+#define FOREVER                 0xFFFFFFFF
+
+// One access point, nothing fancy
+const sim_ap_t single[] = {
+    { "home", "password", {0x02, 0x00, 0x00, 0x00, 0x00, 0x01}, 6, -60, FOREVER, FOREVER }
+};
+
+// The strongest known network has changed its password
+const sim_ap_t badpass[] = {
+    { "office", "newpassword", {0x02, 0x00, 0x00, 0x00, 0x01, 0x01}, 1, -45, FOREVER, FOREVER },
+    { "lab", "password", {0x02, 0x00, 0x00, 0x00, 0x01, 0x02}, 6, -70, FOREVER, FOREVER },
+    { "home", "password", {0x02, 0x00, 0x00, 0x00, 0x01, 0x03}, 11, -75, FOREVER, FOREVER }
+};
+
+// The access point reboots, it is gone for the first 20 seconds
+const sim_ap_t outage[] = {
+    { "home", "password", {0x02, 0x00, 0x00, 0x00, 0x02, 0x01}, 6, -60, 0, 20000 }
+};
+
+// A strong but broken access point and a good one for the same SSID
+const sim_ap_t broken[] = {
+    { "warehouse", "wrongpassword", {0x02, 0x00, 0x00, 0x00, 0x03, 0x01}, 1, -40, FOREVER, FOREVER },
+    { "warehouse", "password", {0x02, 0x00, 0x00, 0x00, 0x03, 0x02}, 6, -65, FOREVER, FOREVER }
+};
+
+// The site access point reboots and takes 90 seconds to come back,
+// every device in the building lost the connection at the same time
+const sim_ap_t reboot[] = {
+    { "site", "password", {0x02, 0x00, 0x00, 0x00, 0x04, 0x01}, 6, -60, 0, 90000 }
+};
+
+// The only access point around hides its SSID
+const sim_ap_t hidden[] = {
+    { "attic", "password", {0x02, 0x00, 0x00, 0x00, 0x05, 0x01}, 6, -55, FOREVER, FOREVER, true },
+    { "neighbour", "password", {0x02, 0x00, 0x00, 0x00, 0x05, 0x02}, 11, -80, FOREVER, FOREVER, false }
+};
+
+// Two access points of the same network, we walk away from the first one
+const sim_ap_t roam[] = {
+    { "home", "password", {0x02, 0x00, 0x00, 0x00, 0x06, 0x01}, 1, -50, FOREVER, FOREVER },
+    { "home", "password", {0x02, 0x00, 0x00, 0x00, 0x06, 0x02}, 11, -65, FOREVER, FOREVER }
+};
+
+// The strongest network only takes one in three attempts
+const sim_ap_t noisy[] = {
+    { "lab", "password", {0x02, 0x00, 0x00, 0x00, 0x07, 0x01}, 1, -55, FOREVER, FOREVER, false, 65 },
+    { "home", "password", {0x02, 0x00, 0x00, 0x00, 0x07, 0x02}, 6, -65, FOREVER, FOREVER, false, 0 }
+};
+
+// Same, but the failed attempts never get an address and have to time out
+const sim_ap_t stall[] = {
+    { "lab", "password", {0x02, 0x00, 0x00, 0x00, 0x08, 0x01}, 1, -55, FOREVER, FOREVER, false, 65, true },
+    { "home", "password", {0x02, 0x00, 0x00, 0x00, 0x08, 0x02}, 6, -65, FOREVER, FOREVER, false, 0, false }
+};
+
+typedef struct {
+    const char * name;
+    const sim_ap_t * aps;
+    uint8_t count;
+    uint8_t auth_fail_ratio;
+    bool wake;      // connect once and measure the reconnection after a reboot
+    unsigned long tick;     // time spent by the rest of the sketch on each loop
+    bool events;            // use radio events instead of polling the status
+    uint8_t relinks;        // drop the link once connected and measure the reconnections
+    unsigned long hold;     // time connected before each drop (ms)
+    unsigned long scan_ttl;
+    bool targeted;          // only scan the channels known networks were seen on
+    int8_t threshold;       // stop scanning once a network this strong shows up
+    bool roam;              // walk towards the other access point once connected and measure the roaming
+    bool learn;             // rank by the learned score, RSSI only otherwise
+    bool adaptive;          // learn the connect timeout of each network
+    unsigned long slowdown; // DHCP takes this much longer (ms) from the middle relink on
+} scenario_t;
+
+const scenario_t scenarios[] = {
+    { "single", single, 1, 0, false, TICK, false, 0, 0, JUSTWIFI_SCAN_TTL, false, 0, false, true, false, 0 },
+    { "badpass", badpass, 3, 0, false, TICK, false, 0, 0, JUSTWIFI_SCAN_TTL, false, 0, false, true, false, 0 },
+    { "outage", outage, 1, 0, false, TICK, false, 0, 0, JUSTWIFI_SCAN_TTL, false, 0, false, true, false, 0 },
+    { "broken", broken, 2, 0, false, TICK, false, 0, 0, JUSTWIFI_SCAN_TTL, false, 0, false, true, false, 0 },
+    { "flaky", single, 1, 30, false, TICK, false, 0, 0, JUSTWIFI_SCAN_TTL, false, 0, false, true, false, 0 },
+    { "wake", single, 1, 0, true, TICK, false, 0, 0, JUSTWIFI_SCAN_TTL, false, 0, false, true, false, 0 },
+    { "busy", badpass, 3, 0, false, 50, false, 0, 0, JUSTWIFI_SCAN_TTL, false, 0, false, true, false, 0 },
+    { "events", badpass, 3, 0, false, TICK, true, 0, 0, JUSTWIFI_SCAN_TTL, false, 0, false, true, false, 0 },
+    { "evflaky", single, 1, 30, false, TICK, true, 0, 0, JUSTWIFI_SCAN_TTL, false, 0, false, true, false, 0 },
+    { "relink", badpass, 3, 0, false, TICK, false, 1, 5000, JUSTWIFI_SCAN_TTL, false, 0, false, true, false, 0 },
+    { "rescan", badpass, 3, 0, false, TICK, false, 1, 5000, 0, false, 0, false, true, false, 0 },
+    { "targeted", badpass, 3, 0, false, TICK, false, 1, 5000, 0, true, 0, false, true, false, 0 },
+    { "early", badpass, 3, 0, false, TICK, false, 1, 5000, 0, true, -72, false, true, false, 0 },
+    { "hidden", hidden, 2, 0, false, TICK, false, 0, 0, JUSTWIFI_SCAN_TTL, false, 0, false, true, false, 0 },
+    { "roam", roam, 2, 0, false, TICK, false, 0, 0, JUSTWIFI_SCAN_TTL, false, 0, true, true, false, 0 },
+    { "noisy", noisy, 2, 0, false, TICK, false, 10, 150000, JUSTWIFI_SCAN_TTL, false, 0, false, true, false, 0 },
+    { "rssionly", noisy, 2, 0, false, TICK, false, 10, 150000, JUSTWIFI_SCAN_TTL, false, 0, false, false, false, 0 },
+    { "stall", stall, 2, 0, false, TICK, false, 10, 150000, JUSTWIFI_SCAN_TTL, false, 0, false, true, true, 0 },
+    { "stallfixed", stall, 2, 0, false, TICK, false, 10, 150000, JUSTWIFI_SCAN_TTL, false, 0, false, true, false, 0 },
+    { "slowdown", single, 1, 0, false, TICK, false, 10, 5000, JUSTWIFI_SCAN_TTL, false, 0, false, true, true, 2600 },
+    { "slowfixed", single, 1, 0, false, TICK, false, 10, 5000, JUSTWIFI_SCAN_TTL, false, 0, false, true, false, 2600 }
+};
+
+// -----------------------------------------------------------------------------
+// Benchmark
+// -----------------------------------------------------------------------------
+
+SimRadio radio;
+
+// Checks that went wrong, the host build exits with this
+unsigned int sim_failed_checks = 0;
+
+void simCheck(bool ok) {
+    if (!ok) sim_failed_checks++;
+}
+
+unsigned long connected_at;
+unsigned int failed;
+unsigned int order_errors;
+
+void benchCallback(const justwifi_event_t & event, void * context) {
+    if (event.message == MESSAGE_CONNECTED) {
+        connected_at = radio.millis();
+        // The state machine must not report a connection before the radio does
+        if (radio.peek() != WL_CONNECTED) order_errors++;
+    }
+    if (event.message == MESSAGE_CONNECT_FAILED) failed++;
+}
+
+void benchConfigure(JustWifi & wifi, const scenario_t & scenario) {
+    wifi.subscribeCallback(benchCallback, NULL,
+        JUSTWIFI_MESSAGE_MASK(MESSAGE_CONNECTED) | JUSTWIFI_MESSAGE_MASK(MESSAGE_CONNECT_FAILED));
+    wifi.enableFastConnect(scenario.wake);
+    wifi.enableAPFallback(false);
+    wifi.enableScan(true);
+    wifi.addNetwork("home", "password");
+    wifi.addNetwork("office", "password");
+    wifi.addNetwork("lab", "password");
+    wifi.addNetwork("warehouse", "password");
+    wifi.addNetwork("attic", "password", NULL, NULL, NULL, NULL, false, NULL, NULL, true);
+    wifi.enableRadioEvents(scenario.events);
+    wifi.setScanTTL(scenario.scan_ttl);
+    wifi.enableTargetedScan(scenario.targeted);
+    wifi.setScanThreshold(scenario.threshold);
+    wifi.enableRoaming(scenario.roam);
+    if (!scenario.learn) wifi.setScoreWeights(1, 0, 0);
+    wifi.enableAdaptiveTimeout(scenario.adaptive);
+}
+
+void benchConnect(JustWifi & wifi, unsigned long tick) {
+    unsigned long start = radio.millis();
+    while ((0 == connected_at) && (radio.millis() - start < TRIAL_LIMIT)) {
+        wifi.loop();
+        radio.advance(tick);
+        // Thousands of loops per trial, keep the watchdog happy on the board
+        yield();
+    }
+}
+
+#ifdef JUSTWIFI_ENABLE_METRICS
+
+unsigned long benchMean(const justwifi_histogram_t & histogram) {
+    return histogram.count ? histogram.total / histogram.count : 0;
+}
+
+// Where the time went in the last trial
+void benchMetrics(const justwifi_metrics_t & metrics) {
+    Serial.printf(
+        "[METRICS] scans: %u (%lu ms) attempts: %u (%lu ms) failures: %u link: %lu ms ip: %lu ms connect: %lu ms\n",
+        metrics.scans, benchMean(metrics.scan),
+        metrics.attempts, benchMean(metrics.attempt),
+        metrics.failures,
+        benchMean(metrics.link), benchMean(metrics.ip), benchMean(metrics.connect)
+    );
+}
+
+#endif
+
+void benchRun(const scenario_t & scenario) {
+
+    unsigned long times[TRIALS];
+    unsigned long scans = 0;
+    unsigned long airtime = 0;
+    unsigned long failures = 0;
+    unsigned int timeouts = 0;
+    unsigned long polls = 0;
+    unsigned int errors = 0;
+    unsigned long attempts = 0;
+    unsigned long connects = 0;
+
+    radio.setAccessPoints(scenario.aps, scenario.count);
+    radio.auth_fail_ratio = scenario.auth_fail_ratio;
+    unsigned long dhcp_time = radio.dhcp_time;
+
+    for (unsigned int trial = 0; trial < TRIALS; trial++) {
+
+        if (scenario.wake) {
+            radio.reset(trial + 1);
+            connected_at = 0;
+            JustWifi wifi(radio);
+            benchConfigure(wifi, scenario);
+            benchConnect(wifi, scenario.tick);
+        }
+
+        radio.reset(trial + 1);
+        connected_at = 0;
+        failed = 0;
+        order_errors = 0;
+
+        JustWifi wifi(radio);
+        benchConfigure(wifi, scenario);
+        benchConnect(wifi, scenario.tick);
+
+        unsigned int connected = connected_at ? 1 : 0;
+
+        // The access point kicks us out a few seconds later, the trial
+        // time is the mean reconnection time
+        unsigned long dropped = 0;
+        unsigned long relinked = 0;
+        for (uint8_t relink = 0; (relink < scenario.relinks) && connected_at; relink++) {
+            if (relink == scenario.relinks / 2) radio.dhcp_time += scenario.slowdown;
+            for (unsigned int i = 0; i < scenario.hold / scenario.tick; i++) {
+                wifi.loop();
+                radio.advance(scenario.tick);
+                yield();
+            }
+            radio.disconnect();
+            dropped = radio.millis();
+            connected_at = 0;
+            benchConnect(wifi, scenario.tick);
+            if (connected_at) {
+                relinked += connected_at - dropped;
+                connected++;
+            }
+        }
+        if (scenario.relinks && connected_at) connected_at = relinked / scenario.relinks;
+
+        // Same network, but the other access point is now much closer
+        if (scenario.roam && connected_at) {
+            radio.setRSSI(0, -85);
+            radio.setRSSI(1, -50);
+            dropped = radio.millis();
+            connected_at = 0;
+            benchConnect(wifi, scenario.tick);
+            if (connected_at) {
+                connected_at -= dropped;
+                connected++;
+            }
+        }
+
+        if (0 == connected_at) {
+            connected_at = TRIAL_LIMIT;
+            timeouts++;
+        }
+
+        radio.dhcp_time = dhcp_time;
+        times[trial] = connected_at;
+        scans += radio.scans;
+        airtime += radio.scan_airtime;
+        failures += failed;
+        polls += radio.polls;
+        attempts += radio.attempts;
+        connects += connected;
+        errors += order_errors + radio.order_errors;
+
+        #ifdef JUSTWIFI_ENABLE_METRICS
+            if (trial == TRIALS - 1) benchMetrics(wifi.getMetrics());
+        #endif
+
+    }
+
+    std::sort(times, times + TRIALS);
+    simCheck((0 == errors) && (0 == timeouts));
+
+    Serial.printf(
+        "[BENCH] %-10s p50: %6lu ms p99: %6lu ms scans: %4.1f (%5lu ms) failed: %4.1f attempts/connect: %4.2f polls: %6.1f timeouts: %u order: %u\n",
+        scenario.name,
+        times[TRIALS / 2],
+        times[(TRIALS * 99) / 100],
+        (float) scans / TRIALS,
+        airtime / TRIALS,
+        (float) failures / TRIALS,
+        connects ? (float) attempts / connects : 0,
+        (float) polls / TRIALS,
+        timeouts,
+        errors
+    );
+
+}
+
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+// Reconnect storm
+// -----------------------------------------------------------------------------
+
+typedef struct {
+    const char * name;
+    justwifi_backoff_t backoff;
+} storm_t;
+
+const storm_t storms[] = {
+    { "fixed", BACKOFF_NONE },
+    { "exponential", BACKOFF_EXPONENTIAL },
+    { "full", BACKOFF_FULL_JITTER },
+    { "decorrelated", BACKOFF_DECORRELATED_JITTER }
+};
+
+typedef struct {
+    SimRadio radio;
+    JustWifi * wifi;
+    unsigned long connected_at;
+} storm_device_t;
+
+uint16_t storm_load[STORM_LIMIT];
+uint16_t storm_fixed_peak = 0;
+
+void stormCallback(const justwifi_event_t & event, void * context) {
+    storm_device_t * device = (storm_device_t *) context;
+    device->connected_at = device->radio.millis();
+}
+
+// The whole fleet runs side by side in the same process,
+// each device with its own JustWifi instance and radio
+void stormRun(const storm_t & storm) {
+
+    memset(storm_load, 0, sizeof(storm_load));
+    sim_air_t air = { STORM_CAPACITY, storm_load, STORM_LIMIT };
+
+    std::vector<storm_device_t> fleet(STORM_DEVICES);
+    for (unsigned int i = 0; i < STORM_DEVICES; i++) {
+        storm_device_t & device = fleet[i];
+        device.radio.reset(i + 1);
+        device.radio.setAccessPoints(reboot, 1);
+        device.radio.air = &air;
+        device.connected_at = 0;
+        device.wifi = new JustWifi(device.radio);
+        device.wifi->subscribeCallback(stormCallback, &device, JUSTWIFI_MESSAGE_MASK(MESSAGE_CONNECTED));
+        device.wifi->enableAPFallback(false);
+        device.wifi->enableScan(true);
+        device.wifi->setReconnectTimeout(10000, storm.backoff, 120000);
+        device.wifi->addNetwork("site", "password");
+    }
+
+    unsigned long cpu = 0;
+    unsigned long loops = 0;
+    unsigned int connected = 0;
+    for (unsigned long now = 0; (now < STORM_LIMIT * 1000UL) && (connected < STORM_DEVICES); now += STORM_TICK) {
+
+        unsigned long start = micros();
+        for (unsigned int i = 0; i < STORM_DEVICES; i++) fleet[i].wifi->loop();
+        cpu += micros() - start;
+        loops += STORM_DEVICES;
+        yield();
+
+        connected = 0;
+        for (unsigned int i = 0; i < STORM_DEVICES; i++) {
+            fleet[i].radio.advance(STORM_TICK);
+            if (fleet[i].connected_at) connected++;
+        }
+
+    }
+
+    unsigned long times[STORM_DEVICES];
+    for (unsigned int i = 0; i < STORM_DEVICES; i++) {
+        times[i] = fleet[i].connected_at ? fleet[i].connected_at : STORM_LIMIT * 1000UL;
+        delete fleet[i].wifi;
+    }
+    std::sort(times, times + STORM_DEVICES);
+
+    uint16_t peak = 0;
+    for (unsigned int second = 0; second < STORM_LIMIT; second++) {
+        if (storm_load[second] > peak) peak = storm_load[second];
+    }
+
+    // Jitter has to spread the fleet out and still get everybody back
+    if (BACKOFF_NONE == storm.backoff) storm_fixed_peak = peak;
+    if ((BACKOFF_FULL_JITTER == storm.backoff) || (BACKOFF_DECORRELATED_JITTER == storm.backoff)) {
+        simCheck((STORM_DEVICES == connected) && (10 * peak <= storm_fixed_peak));
+    }
+
+    Serial.printf(
+        "[STORM] %-12s peak: %4u assoc/s p50: %6lu ms p99: %6lu ms connected: %4u/%u cpu: %5.2f us/loop\n",
+        storm.name,
+        peak,
+        times[STORM_DEVICES / 2],
+        times[(STORM_DEVICES * 99) / 100],
+        connected, STORM_DEVICES,
+        (float) cpu / loops
+    );
+
+}
+
+// -----------------------------------------------------------------------------
+// SSID index
+// -----------------------------------------------------------------------------
+
+#define INDEX_RESULTS           60
+#define INDEX_REPEAT            20
+
+// A few hundred networks do not fit in the board RAM
+#if defined(ESP8266)
+const uint16_t index_sizes[] = { 10, 100 };
+#else
+const uint16_t index_sizes[] = { 10, 100, 255 };
+#endif
+
+char index_ssids[INDEX_RESULTS][16];
+sim_ap_t index_aps[INDEX_RESULTS];
+
+// The library matches the scan results between scanComplete() and
+// scanDelete(), the radio times that
+class IndexRadio : public SimRadio {
+
+    public:
+
+        unsigned long elapsed = 0;
+
+        int8_t scanComplete() {
+            int8_t count = SimRadio::scanComplete();
+            if (count > 0) _start = micros();
+            return count;
+        }
+
+        void scanDelete() {
+            if (_start) elapsed += micros() - _start;
+            _start = 0;
+            SimRadio::scanDelete();
+        }
+
+    private:
+
+        unsigned long _start = 0;
+
+};
+
+// One in three access points belongs to a known network (known000 and on)
+void indexAccessPoints(uint16_t size) {
+    for (uint8_t i = 0; i < INDEX_RESULTS; i++) {
+        if (0 == i % 3) {
+            snprintf(index_ssids[i], sizeof(index_ssids[i]), "known%03u", (i / 3) % size);
+        } else {
+            snprintf(index_ssids[i], sizeof(index_ssids[i]), "other%03u", i);
+        }
+        sim_ap_t ap = { index_ssids[i], "password", {0x02, 0x00, 0x00, 0x01, 0x00, i}, (uint8_t) (1 + i % 11), (int8_t) (-40 - i / 2), FOREVER, FOREVER };
+        index_aps[i] = ap;
+    }
+}
+
+// One hash probe per scan result against the nested loop it replaced,
+// a String per result compared with every known network
+void indexRun() {
+
+    for (uint8_t s = 0; s < sizeof(index_sizes) / sizeof(index_sizes[0]); s++) {
+
+        uint16_t size = index_sizes[s];
+        indexAccessPoints(size);
+
+        std::vector<char> names(size * 16);
+        for (uint16_t i = 0; i < size; i++) {
+            snprintf(&names[i * 16], 16, "known%03u", i);
+        }
+
+        IndexRadio index_radio;
+        unsigned long indexed = 0;
+        unsigned int matched = 0;
+        for (uint8_t repeat = 0; repeat < INDEX_REPEAT; repeat++) {
+
+            index_radio.reset(repeat + 1);
+            index_radio.setAccessPoints(index_aps, INDEX_RESULTS);
+            index_radio.elapsed = 0;
+
+            JustWifi wifi(index_radio);
+            wifi.enableAPFallback(false);
+            wifi.enableScan(true);
+            wifi.enablePMKCache(false);
+            for (uint16_t i = 0; i < size; i++) wifi.addNetwork(&names[i * 16], "password");
+
+            while (0 == index_radio.elapsed) {
+                wifi.loop();
+                index_radio.advance(TICK);
+            }
+            indexed += index_radio.elapsed;
+            yield();
+
+        }
+
+        // Same results, the way it was done before
+        unsigned long nested = 0;
+        justwifi_scan_result_t result;
+        char ssid[JUSTWIFI_SSID_SIZE + 1];
+        for (uint8_t repeat = 0; repeat < INDEX_REPEAT; repeat++) {
+            index_radio.scanNetworks(false, true);
+            index_radio.advance(index_radio.scan_time);
+            int8_t count = index_radio.scanComplete();
+            unsigned long start = micros();
+            for (int8_t i = 0; i < count; i++) {
+                if (!index_radio.getScanResult(i, result)) continue;
+                memcpy(ssid, result.ssid, result.ssid_len);
+                ssid[result.ssid_len] = 0x00;
+                String ssid_scan = ssid;
+                for (uint16_t j = 0; j < size; j++) {
+                    if (ssid_scan.equals(&names[j * 16])) {
+                        matched++;
+                        break;
+                    }
+                }
+            }
+            nested += micros() - start;
+            index_radio.scanDelete();
+        }
+
+        simCheck(matched == INDEX_REPEAT * INDEX_RESULTS / 3);
+
+        Serial.printf(
+            "[INDEX] networks: %3u results: %u indexed: %7.1f us nested: %7.1f us\n",
+            size, INDEX_RESULTS,
+            (float) indexed / INDEX_REPEAT,
+            (float) nested / INDEX_REPEAT
+        );
+
+    }
+
+}
+
+// -----------------------------------------------------------------------------
+// Event queue
+// -----------------------------------------------------------------------------
+
+#define QUEUE_SLOW              20
+
+unsigned int queue_delivered;
+
+void queueCallback(const justwifi_event_t & event, void * context) {
+    queue_delivered++;
+    // Blocks for a while, like a subscriber starting mDNS on connect
+    if (context) radio.advance(QUEUE_SLOW);
+}
+
+void queueRun() {
+
+    // A scan reports more networks than the queue holds, in a single loop()
+    indexAccessPoints(INDEX_RESULTS);
+    radio.reset(1);
+    radio.setAccessPoints(index_aps, INDEX_RESULTS);
+    radio.auth_fail_ratio = 0;
+    queue_delivered = 0;
+
+    JustWifi flood(radio);
+    flood.enableAPFallback(false);
+    flood.enableScan(true);
+    flood.addNetwork("known000", "password");
+    flood.enableEventQueue(true);
+    flood.subscribeCallback(queueCallback, NULL, JUSTWIFI_MESSAGE_MASK(MESSAGE_FOUND_NETWORK));
+    while (radio.millis() < radio.scan_time + 2 * TICK) {
+        flood.loop();
+        radio.advance(TICK);
+    }
+
+    justwifi_queue_stats_t stats = flood.getEventQueueStats();
+    bool overflow_ok = (JUSTWIFI_EVENT_QUEUE_SIZE == stats.queued) && (INDEX_RESULTS - JUSTWIFI_EVENT_QUEUE_SIZE == stats.dropped);
+    overflow_ok = overflow_ok && (JUSTWIFI_EVENT_QUEUE_SIZE == stats.peak) && (0 == stats.count);
+    overflow_ok = overflow_ok && (JUSTWIFI_EVENT_QUEUE_SIZE == queue_delivered);
+
+    // A slow subscriber only gets one event per loop() with a 5 ms budget,
+    // every event still gets there
+    radio.reset(1);
+    radio.setAccessPoints(single, 1);
+    connected_at = 0;
+    queue_delivered = 0;
+
+    JustWifi slow(radio);
+    slow.enableAPFallback(false);
+    slow.enableScan(true);
+    slow.addNetwork("home", "password");
+    slow.enableEventQueue(true, 5);
+    slow.subscribeCallback(queueCallback, &slow);
+    slow.subscribeCallback(benchCallback, NULL, JUSTWIFI_MESSAGE_MASK(MESSAGE_CONNECTED));
+
+    unsigned int most = 0;
+    unsigned long start = radio.millis();
+    while (radio.millis() - start < TRIAL_LIMIT) {
+        unsigned int before = queue_delivered;
+        slow.loop();
+        radio.advance(TICK);
+        if (queue_delivered - before > most) most = queue_delivered - before;
+        if (connected_at && (0 == slow.getEventQueueStats().count)) break;
+    }
+
+    stats = slow.getEventQueueStats();
+    bool budget_ok = (connected_at > 0) && (1 == most);
+    budget_ok = budget_ok && (0 == stats.dropped) && (0 == stats.count) && (stats.queued == queue_delivered);
+
+    simCheck(overflow_ok && budget_ok);
+
+    Serial.printf(
+        "[QUEUE] overflow: %s (%u queued, %u dropped, peak %u) budget: %s (%u events, at most %u per loop)\n",
+        overflow_ok ? "ok" : "FAILED",
+        flood.getEventQueueStats().queued, flood.getEventQueueStats().dropped, flood.getEventQueueStats().peak,
+        budget_ok ? "ok" : "FAILED",
+        queue_delivered, most
+    );
+
+}
+
+// -----------------------------------------------------------------------------
+// PMK
+// -----------------------------------------------------------------------------
+
+typedef struct {
+    const char * pass;
+    const char * salt;
+    uint16_t iterations;
+    uint8_t length;
+    const char * key;
+} pmk_vector_t;
+
+// RFC 6070 PBKDF2-HMAC-SHA1 vectors, but the 16777216 iterations one and
+// the one with NULs in the password, and the IEEE 802.11i PSK test vector
+const pmk_vector_t pmk_vectors[] = {
+    { "password", "salt", 1, 20, "0c60c80f961f0e71f3a9b524af6012062fe037a6" },
+    { "password", "salt", 2, 20, "ea6c014dc72d6f8ccd1ed92ace1d41f0d8de8957" },
+    { "password", "salt", 4096, 20, "4b007901b765489abead49d926f721d065a429c1" },
+    { "passwordPASSWORDpassword", "saltSALTsaltSALTsaltSALTsaltSALTsalt", 4096, 25, "3d2eec4fe41c849b80c8d83662c0e44a8b291a964cf2f07038" },
+    { "password", "IEEE", 4096, 32, "f42c6fc52df0ebef9ebb4b90b38a5f902e83fe1b135a70e23aed762e9710a12e" }
+};
+
+// A WEP key that is a valid WPA passphrase too
+const sim_ap_t wep[] = {
+    { "cellar", "0123456789", {0x02, 0x00, 0x00, 0x00, 0x09, 0x01}, 6, -60, FOREVER, FOREVER, false, 0, false, true }
+};
+
+#define PMK_RELINKS             5
+
+void pmkRun() {
+
+    uint8_t count = sizeof(pmk_vectors) / sizeof(pmk_vectors[0]);
+    uint8_t passed = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        const pmk_vector_t & vector = pmk_vectors[i];
+        JustWifiPMK job;
+        job.begin(vector.pass, (const uint8_t *) vector.salt, strlen(vector.salt), vector.iterations, vector.length);
+        while (!job.step(256)) yield();
+        uint8_t key[40];
+        char hex[81];
+        job.get(key);
+        for (uint8_t j = 0; j < vector.length; j++) snprintf(&hex[2*j], 3, "%02x", key[j]);
+        if (strcmp(hex, vector.key) == 0) passed++;
+    }
+
+    // Without a scan to tell, the key has to keep going as it is
+    // once its PMK has been derived
+    radio.reset(1);
+    radio.setAccessPoints(wep, 1);
+    radio.auth_fail_ratio = 0;
+    connected_at = 0;
+    JustWifi wifi(radio);
+    wifi.subscribeCallback(benchCallback, NULL, JUSTWIFI_MESSAGE_MASK(MESSAGE_CONNECTED));
+    wifi.enableAPFallback(false);
+    wifi.enableScan(false);
+    wifi.addNetwork("cellar", "0123456789");
+    benchConnect(wifi, TICK);
+    uint8_t relinks = 0;
+    while (connected_at && (relinks < PMK_RELINKS)) {
+        radio.disconnect();
+        connected_at = 0;
+        benchConnect(wifi, TICK);
+        if (connected_at) relinks++;
+    }
+
+    simCheck((passed == count) && (PMK_RELINKS == relinks));
+
+    Serial.printf(
+        "[PMK] vectors: %u/%u wep relinks: %u/%u\n",
+        passed, count,
+        relinks, PMK_RELINKS
+    );
+
+}
+
+// -----------------------------------------------------------------------------
+// Heap allocations
+// -----------------------------------------------------------------------------
+
+#ifdef SIM_COUNT_ALLOCATIONS
+
+#define ALLOC_NETWORKS          8
+#define ALLOC_CYCLES            5
+#define ALLOC_DENSE             SIM_MAX_APS
+
+// One network with as many access points as the radio can simulate,
+// the strongest one (by far) last
+sim_ap_t alloc_dense[ALLOC_DENSE];
+
+// Allocations of a first connection through count access points
+unsigned long allocDense(uint8_t count, bool & strongest) {
+
+    radio.reset(1);
+    radio.setAccessPoints(&alloc_dense[ALLOC_DENSE - count], count);
+    connected_at = 0;
+
+    JustWifi wifi(radio);
+    wifi.subscribeCallback(benchCallback, NULL, JUSTWIFI_MESSAGE_MASK(MESSAGE_CONNECTED));
+    wifi.enableAPFallback(false);
+    wifi.enableScan(true);
+    wifi.addNetwork("home", "password");
+
+    unsigned long before = sim_allocations;
+    benchConnect(wifi, TICK);
+    unsigned long allocations = sim_allocations - before;
+
+    const uint8_t * bssid = radio.BSSID();
+    strongest = connected_at && bssid && (memcmp(bssid, alloc_dense[ALLOC_DENSE - 1].bssid, 6) == 0);
+    return allocations;
+
+}
+
+// Once the lists have grown, adding and cleaning networks
+// and reconnecting (scan included) must not touch the heap
+void allocRun() {
+
+    radio.reset(1);
+    radio.setAccessPoints(badpass, 3);
+    radio.auth_fail_ratio = 0;
+
+    JustWifi wifi(radio);
+    wifi.subscribeCallback(benchCallback, NULL, JUSTWIFI_MESSAGE_MASK(MESSAGE_CONNECTED));
+    wifi.enableAPFallback(false);
+    wifi.enableScan(true);
+    wifi.setScanTTL(0);
+
+    unsigned long add_first = 0;
+    unsigned long add_then = 0;
+    char ssid[16];
+    for (uint8_t cycle = 0; cycle < ALLOC_CYCLES; cycle++) {
+        unsigned long before = sim_allocations;
+        for (uint8_t i = 0; i < ALLOC_NETWORKS; i++) {
+            snprintf(ssid, sizeof(ssid), "network%02u", i);
+            wifi.addNetwork(ssid, "password");
+        }
+        wifi.cleanNetworks();
+        unsigned long count = sim_allocations - before;
+        if (0 == cycle) add_first = count; else add_then += count;
+    }
+
+    wifi.addNetwork("home", "password");
+    wifi.addNetwork("office", "password");
+    wifi.addNetwork("lab", "password");
+
+    unsigned long reconnect_first = 0;
+    unsigned long reconnect_then = 0;
+    uint8_t connected = 0;
+    for (uint8_t cycle = 0; cycle < ALLOC_CYCLES; cycle++) {
+        radio.disconnect();
+        connected_at = 0;
+        unsigned long before = sim_allocations;
+        benchConnect(wifi, TICK);
+        unsigned long count = sim_allocations - before;
+        if (0 == cycle) reconnect_first = count; else reconnect_then += count;
+        if (connected_at) connected++;
+    }
+
+    // A dense scan costs the same as JUSTWIFI_MAX_BSSIDS access points
+    for (uint8_t i = 0; i < ALLOC_DENSE; i++) {
+        sim_ap_t ap = { "home", "password", {0x02, 0x00, 0x00, 0x00, 0x07, i}, (uint8_t) (1 + i % 11), (int8_t) ((i == ALLOC_DENSE - 1) ? -40 : -90 + i / 2), FOREVER, FOREVER };
+        alloc_dense[i] = ap;
+    }
+    bool sparse_strongest;
+    bool dense_strongest;
+    unsigned long sparse = allocDense(JUSTWIFI_MAX_BSSIDS, sparse_strongest);
+    unsigned long dense = allocDense(ALLOC_DENSE, dense_strongest);
+
+    simCheck((0 == add_then) && (0 == reconnect_then) && (ALLOC_CYCLES == connected));
+    simCheck((dense == sparse) && sparse_strongest && dense_strongest);
+
+    Serial.printf(
+        "[ALLOC] add/clean %u networks: %lu then %lu reconnect: %lu then %lu (%u/%u connected) scan of %u/%u access points: %lu/%lu%s\n",
+        ALLOC_NETWORKS,
+        add_first, add_then,
+        reconnect_first, reconnect_then,
+        connected, ALLOC_CYCLES,
+        JUSTWIFI_MAX_BSSIDS, ALLOC_DENSE,
+        sparse, dense,
+        (sparse_strongest && dense_strongest) ? "" : " (not the strongest)"
+    );
+
+}
+
+#endif
+
+// -----------------------------------------------------------------------------
+// List changes
+// -----------------------------------------------------------------------------
+
+// Connects to the single access point, changing the network list
+// in the middle of the first attempt
+bool listAttempt(JustWifi & wifi, void (*change)(JustWifi & wifi)) {
+    radio.reset(1);
+    radio.setAccessPoints(single, 1);
+    radio.auth_fail_ratio = 0;
+    connected_at = 0;
+    wifi.subscribeCallback(benchCallback, NULL, JUSTWIFI_MESSAGE_MASK(MESSAGE_CONNECTED));
+    wifi.enableAPFallback(false);
+    wifi.enableScan(true);
+    wifi.addNetwork("home", "password");
+    while (radio.millis() < radio.scan_time + radio.assoc_time / 2) {
+        wifi.loop();
+        radio.advance(TICK);
+    }
+    change(wifi);
+    benchConnect(wifi, TICK);
+    return (connected_at > 0);
+}
+
+void listAddFront(JustWifi & wifi) {
+    wifi.addNetwork("guest", "password", NULL, NULL, NULL, NULL, true);
+}
+
+// Imports the same networks in another order,
+// the one being tried is not first anymore
+void listReplace(JustWifi & wifi) {
+    JustWifi source(radio);
+    source.addNetwork("guest", "password");
+    source.addNetwork("home", "password");
+    std::vector<uint8_t> image(source.exportNetworks(NULL, 0));
+    source.exportNetworks(image.data(), image.size());
+    wifi.importNetworks(image.data(), image.size());
+}
+
+bool list_roamed;
+
+void listRoamCallback(const justwifi_event_t & event, void * context) {
+    list_roamed = (strcmp(event.ssid, "home") == 0);
+}
+
+// Same SSID with another password, in front of the one that connected
+void listAddSame(JustWifi & wifi) {
+    wifi.addNetwork("home", "oldpassword", NULL, NULL, NULL, NULL, true);
+}
+
+// Walks towards the second access point and changes the network list
+// as soon as the roaming scan starts (or before walking if early),
+// returns the time to roam
+unsigned long listRoam(JustWifi & wifi, void (*change)(JustWifi & wifi), bool early) {
+
+    radio.reset(1);
+    radio.setAccessPoints(roam, 2);
+    connected_at = 0;
+    list_roamed = false;
+    wifi.subscribeCallback(benchCallback, NULL, JUSTWIFI_MESSAGE_MASK(MESSAGE_CONNECTED));
+    wifi.subscribeCallback(listRoamCallback, NULL, JUSTWIFI_MESSAGE_MASK(MESSAGE_ROAMING));
+    wifi.enableAPFallback(false);
+    wifi.enableScan(true);
+    wifi.enableRoaming(true);
+    wifi.addNetwork("home", "password");
+    benchConnect(wifi, TICK);
+    if (!connected_at) return 0;
+    if (early) change(wifi);
+
+    radio.setRSSI(0, -85);
+    radio.setRSSI(1, -50);
+    unsigned long start = radio.millis();
+    unsigned int scans = radio.scans;
+    while ((radio.scans == scans) && (radio.millis() - start < TRIAL_LIMIT)) {
+        wifi.loop();
+        radio.advance(TICK);
+    }
+    if (!early) change(wifi);
+
+    connected_at = 0;
+    benchConnect(wifi, TICK);
+    return (connected_at && list_roamed) ? connected_at - start : 0;
+
+}
+
+// The attempt (or the roaming) has to go on with the same network
+void listRun() {
+
+    justwifi_stats_t home;
+    justwifi_stats_t guest;
+
+    JustWifi front(radio);
+    bool front_ok = listAttempt(front, listAddFront);
+    front_ok = front_ok && front.getNetworkStats("home", home) && front.getNetworkStats("guest", guest);
+    front_ok = front_ok && (home.success > 128) && (128 == guest.success);
+
+    // The attempt with the old list is dropped and a new one made
+    JustWifi replace(radio);
+    bool replace_ok = listAttempt(replace, listReplace);
+    replace_ok = replace_ok && replace.getNetworkStats("home", home) && replace.getNetworkStats("guest", guest);
+    replace_ok = replace_ok && (home.success > 128) && (128 == guest.success);
+
+    // Well before the next roaming interval
+    JustWifi roaming(radio);
+    unsigned long roamed = listRoam(roaming, listAddFront, false);
+    bool roam_ok = (roamed > 0) && (roamed < JUSTWIFI_ROAMING_INTERVAL / 2);
+
+    // Roams with the credentials that connected, not the first "home"
+    JustWifi same(radio);
+    unsigned long roamed_same = listRoam(same, listAddSame, true);
+    bool same_ok = (roamed_same > 0) && (roamed_same < JUSTWIFI_ROAMING_INTERVAL / 2);
+
+    simCheck(front_ok && replace_ok && roam_ok && same_ok);
+
+    Serial.printf(
+        "[LIST] add in front during an attempt: %s replace during an attempt: %s while roaming: %s (%lu ms) same SSID while roaming: %s (%lu ms)\n",
+        front_ok ? "ok" : "FAILED",
+        replace_ok ? "ok" : "FAILED",
+        roam_ok ? "ok" : "FAILED",
+        roamed,
+        same_ok ? "ok" : "FAILED",
+        roamed_same
+    );
+
+}
+
+// -----------------------------------------------------------------------------
+// Instances
+// -----------------------------------------------------------------------------
+
+typedef struct {
+    SimRadio radio;
+    unsigned long connected_at;
+} instance_t;
+
+void instanceCallback(const justwifi_event_t & event, void * context) {
+    instance_t * instance = (instance_t *) context;
+    instance->connected_at = instance->radio.millis();
+}
+
+void instanceConfigure(JustWifi & wifi, instance_t & instance) {
+    instance.connected_at = 0;
+    wifi.subscribeCallback(instanceCallback, &instance, JUSTWIFI_MESSAGE_MASK(MESSAGE_CONNECTED));
+    wifi.enableAPFallback(false);
+    wifi.enableScan(true);
+    wifi.addNetwork("home", "password");
+    wifi.addNetwork("office", "password");
+    wifi.addNetwork("lab", "password");
+    wifi.addNetwork("warehouse", "password");
+}
+
+// Two instances stepped in turns have to behave
+// exactly like each one of them running alone
+void instancesRun() {
+
+    const scenario_t * pair[2] = { &scenarios[1], &scenarios[2] };     // badpass, outage
+
+    unsigned long alone[2];
+    for (uint8_t i = 0; i < 2; i++) {
+        instance_t instance;
+        instance.radio.reset(i + 1);
+        instance.radio.setAccessPoints(pair[i]->aps, pair[i]->count);
+        JustWifi wifi(instance.radio);
+        instanceConfigure(wifi, instance);
+        while (!instance.connected_at && (instance.radio.millis() < TRIAL_LIMIT)) {
+            wifi.loop();
+            instance.radio.advance(TICK);
+        }
+        alone[i] = instance.connected_at;
+    }
+
+    instance_t a;
+    instance_t b;
+    a.radio.reset(1);
+    a.radio.setAccessPoints(pair[0]->aps, pair[0]->count);
+    b.radio.reset(2);
+    b.radio.setAccessPoints(pair[1]->aps, pair[1]->count);
+    JustWifi wifi_a(a.radio);
+    JustWifi wifi_b(b.radio);
+    instanceConfigure(wifi_a, a);
+    instanceConfigure(wifi_b, b);
+    while ((!a.connected_at || !b.connected_at) && (a.radio.millis() < TRIAL_LIMIT)) {
+        wifi_a.loop();
+        a.radio.advance(TICK);
+        wifi_b.loop();
+        b.radio.advance(TICK);
+    }
+
+    bool ok = alone[0] && alone[1] && (a.connected_at == alone[0]) && (b.connected_at == alone[1]);
+    simCheck(ok);
+
+    Serial.printf(
+        "[INSTANCES] %s alone: %lu ms and %lu ms side by side: %lu ms and %lu ms\n",
+        ok ? "ok" : "FAILED",
+        alone[0], alone[1],
+        a.connected_at, b.connected_at
+    );
+
+}
+
+// -----------------------------------------------------------------------------
+// Network list persistence
+// -----------------------------------------------------------------------------
+
+#define PERSIST_NETWORKS        16
+
+// Fixed size memory stream, stands in for a flash file
+class MemoryStream : public Stream {
+
+    public:
+
+        MemoryStream(uint8_t * buffer, size_t size) : _buffer(buffer), _size(size) {}
+
+        size_t write(uint8_t c) {
+            if (_length >= _size) return 0;
+            _buffer[_length++] = c;
+            return 1;
+        }
+        int available() { return _length - _position; }
+        int read() { return (_position < _length) ? _buffer[_position++] : -1; }
+        int peek() { return (_position < _length) ? _buffer[_position] : -1; }
+        void flush() {}
+
+    private:
+
+        uint8_t * _buffer;
+        size_t _size;
+        size_t _length = 0;
+        size_t _position = 0;
+
+};
+
+void persistConfigure(JustWifi & wifi) {
+    char ssid[16];
+    for (unsigned char i = 0; i < PERSIST_NETWORKS; i++) {
+        snprintf(ssid, sizeof(ssid), "network%02u", i);
+        if (0 == i % 4) {
+            wifi.addNetwork(ssid, "password", "192.168.1.50", "192.168.1.1", "255.255.255.0", "192.168.1.1");
+        } else {
+            wifi.addNetwork(ssid, "password");
+        }
+    }
+    wifi.addNetwork("psk", "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef");
+    wifi.setPriority("network03", 5);
+}
+
+void persistRun() {
+
+    radio.reset(1);
+
+    JustWifi source(radio);
+    unsigned long start = micros();
+    persistConfigure(source);
+    unsigned long added = micros() - start;
+    justwifi_stats_t stats = { -60 * 16, 200, 900, 150 };
+    source.setNetworkStats("network01", stats);
+
+    size_t size = source.exportNetworks(NULL, 0);
+    std::vector<uint8_t> image(size);
+    std::vector<uint8_t> copy(size);
+    start = micros();
+    source.exportNetworks(image.data(), size);
+    unsigned long exported = micros() - start;
+
+    // Through a buffer
+    JustWifi target(radio);
+    start = micros();
+    bool ok = target.importNetworks(image.data(), size);
+    unsigned long imported = micros() - start;
+    ok = ok && (target.exportNetworks(copy.data(), size) == size) && (memcmp(image.data(), copy.data(), size) == 0);
+    ok = ok && target.getNetworkStats("network01", stats) && (900 == stats.time);
+
+    // And through a stream
+    memset(copy.data(), 0, size);
+    MemoryStream stream(copy.data(), size);
+    JustWifi streamed(radio);
+    ok = ok && (source.exportNetworks(stream) == size) && streamed.importNetworks(stream);
+    ok = ok && (memcmp(image.data(), copy.data(), size) == 0);
+
+    // Any flipped bit or missing byte has to be rejected,
+    // leaving the current list untouched
+    unsigned int corrupted = 0;
+    for (size_t i = 0; i < size; i++) {
+        image[i] ^= 1 << (i % 8);
+        if (target.importNetworks(image.data(), size)) corrupted++;
+        image[i] ^= 1 << (i % 8);
+        yield();
+    }
+    unsigned int truncated = 0;
+    for (size_t length = 0; length < size; length++) {
+        if (target.importNetworks(image.data(), length)) truncated++;
+    }
+    ok = ok && (target.exportNetworks(copy.data(), size) == size) && (memcmp(image.data(), copy.data(), size) == 0);
+    simCheck(ok && (0 == corrupted) && (0 == truncated));
+
+    Serial.printf(
+        "[PERSIST] networks: %u image: %u bytes round trip: %s corrupted accepted: %u/%u truncated accepted: %u/%u add: %lu us export: %lu us import: %lu us\n",
+        PERSIST_NETWORKS + 1,
+        (unsigned int) size,
+        ok ? "ok" : "FAILED",
+        corrupted, (unsigned int) size,
+        truncated, (unsigned int) size,
+        added, exported, imported
+    );
+
+}
+
+// -----------------------------------------------------------------------------
+// Bulk provisioning
+// -----------------------------------------------------------------------------
+
+#define PROVISION_NETWORKS      64
+
+char provision_ssids[PROVISION_NETWORKS][16];
+justwifi_network_t provision[PROVISION_NETWORKS];
+
+// Learned success of the network with the given password, from the image
+uint8_t provisionSuccess(JustWifi & wifi, const char * pass) {
+    std::vector<uint8_t> image(wifi.exportNetworks(NULL, 0));
+    wifi.exportNetworks(image.data(), image.size());
+    justwifi_image_t header;
+    memcpy(&header, image.data(), sizeof(header));
+    for (uint16_t i = 0; i < header.count; i++) {
+        network_t network;
+        memcpy(&network, image.data() + sizeof(header) + i * sizeof(network), sizeof(network));
+        if (strcmp(network.pass, pass) == 0) return network.stats.success;
+    }
+    return 0;
+}
+
+void provisionRun() {
+
+    for (unsigned char i = 0; i < PROVISION_NETWORKS; i++) {
+        snprintf(provision_ssids[i], sizeof(provision_ssids[i]), "network%02u", i);
+        justwifi_network_t config = { provision_ssids[i], "password", NULL, NULL, NULL, NULL, NULL, NULL, false, (uint8_t) (i % 3) };
+        provision[i] = config;
+    }
+
+    radio.reset(1);
+    radio.setAccessPoints(single, 1);
+
+    // One network at a time, each one in front of the previous ones
+    JustWifi inserted(radio);
+    unsigned long start = micros();
+    for (int i = PROVISION_NETWORKS - 1; i >= 0; i--) {
+        inserted.addNetwork(provision[i].ssid, provision[i].pass, NULL, NULL, NULL, NULL, true);
+        inserted.setPriority(provision[i].ssid, provision[i].priority);
+    }
+    unsigned long one = micros() - start;
+
+    // All of them at once
+    JustWifi bulk(radio);
+    start = micros();
+    bool ok = bulk.setNetworks(provision, PROVISION_NETWORKS);
+    unsigned long all = micros() - start;
+
+    // Again, every network is matched against the current list
+    start = micros();
+    ok = ok && bulk.setNetworks(provision, PROVISION_NETWORKS);
+    unsigned long again = micros() - start;
+
+    size_t size = bulk.exportNetworks(NULL, 0);
+    std::vector<uint8_t> a(size);
+    std::vector<uint8_t> b(size);
+    ok = ok && (inserted.exportNetworks(a.data(), size) == size) && (bulk.exportNetworks(b.data(), size) == size);
+    ok = ok && (memcmp(a.data(), b.data(), size) == 0);
+
+    // An invalid entry leaves the list as it was
+    provision[PROVISION_NETWORKS / 2].ssid = "";
+    ok = ok && !bulk.setNetworks(provision, PROVISION_NETWORKS);
+    provision[PROVISION_NETWORKS / 2].ssid = provision_ssids[PROVISION_NETWORKS / 2];
+    ok = ok && (bulk.exportNetworks(b.data(), size) == size) && (memcmp(a.data(), b.data(), size) == 0);
+
+    // Replacing the list in the middle of a connection attempt
+    connected_at = 0;
+    JustWifi wifi(radio);
+    wifi.subscribeCallback(benchCallback, NULL, JUSTWIFI_MESSAGE_MASK(MESSAGE_CONNECTED));
+    wifi.enableAPFallback(false);
+    wifi.enableScan(true);
+    wifi.addNetwork("home", "password");
+    while (radio.millis() < radio.scan_time + radio.assoc_time / 2) {
+        wifi.loop();
+        radio.advance(TICK);
+    }
+    justwifi_network_t home = { "home", "password", NULL, NULL, NULL, NULL, NULL, NULL, false, 0 };
+    ok = ok && wifi.setNetworks(&home, 1);
+    unsigned long swapped = radio.millis();
+    benchConnect(wifi, TICK);
+    ok = ok && (connected_at > 0);
+    unsigned long reconnected = connected_at ? connected_at - swapped : 0;
+
+    // Two entries for the same SSID, each one keeps its own history
+    radio.reset(1);
+    radio.setAccessPoints(single, 1);
+    connected_at = 0;
+    JustWifi twice(radio);
+    twice.subscribeCallback(benchCallback, NULL, JUSTWIFI_MESSAGE_MASK(MESSAGE_CONNECTED));
+    twice.enableAPFallback(false);
+    twice.enableScan(false);
+    justwifi_network_t both[] = {
+        { "home", "oldpassword", NULL, NULL, NULL, NULL, NULL, NULL, false, 0 },
+        { "home", "password", NULL, NULL, NULL, NULL, NULL, NULL, false, 0 }
+    };
+    ok = ok && twice.setNetworks(both, 2);
+    benchConnect(twice, TICK);
+    uint8_t learned = provisionSuccess(twice, "password");
+    ok = ok && (connected_at > 0) && (learned > 128);
+    ok = ok && twice.setNetworks(both, 2) && (provisionSuccess(twice, "password") == learned);
+
+    simCheck(ok);
+
+    Serial.printf(
+        "[PROVISION] networks: %u add front: %lu us setNetworks: %lu us (again: %lu us) checks: %s reconnected after swap: %lu ms\n",
+        PROVISION_NETWORKS,
+        one, all, again,
+        ok ? "ok" : "FAILED",
+        reconnected
+    );
+
+}
+
+void setup() {
+
+    Serial.begin(115200);
+    delay(2000);
+    Serial.println();
+    Serial.println();
+
+    for (unsigned char i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        benchRun(scenarios[i]);
+        yield();
+    }
+
+    indexRun();
+    queueRun();
+    pmkRun();
+    #ifdef SIM_COUNT_ALLOCATIONS
+        allocRun();
+    #endif
+    listRun();
+    instancesRun();
+    persistRun();
+    provisionRun();
+
+    for (unsigned char i = 0; i < sizeof(storms) / sizeof(storms[0]); i++) {
+        stormRun(storms[i]);
+        yield();
+    }
+
+}
+
+void loop() {
+    delay(1000);
+}
@@ -25,34 +25,52 @@ along with the JustWifi library.  If not, see <http://www.gnu.org/licenses/>.
 #include <functional>
 
 // -----------------------------------------------------------------------------
-// WPS callbacks
+// Helpers
 // -----------------------------------------------------------------------------
 
-#if defined(JUSTWIFI_ENABLE_WPS)
-
-#include "user_interface.h"
-
-wps_cb_status _jw_wps_status;
+// Bitwise CRC-32 (IEEE 802.3), slow but table-less
+static uint32_t _jw_crc32(const void * data, size_t length, uint32_t crc = 0) {
+    const uint8_t * bytes = (const uint8_t *) data;
+    crc = ~crc;
+    while (length--) {
+        crc ^= *bytes++;
+        for (uint8_t k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
 
-void _jw_wps_status_cb(wps_cb_status status) {
-    _jw_wps_status = status;
+// xorshift32, state must not be 0
+static uint32_t _jw_random(uint32_t & state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
 }
 
-#endif // defined(JUSTWIFI_ENABLE_WPS)
+#if defined(JUSTWIFI_ENABLE_WPS)
+// There is only one radio, so only one instance can run WPS at a time
+JustWifi * JustWifi::_wps_instance = NULL;
+#endif
 
 //------------------------------------------------------------------------------
 // CONSTRUCTOR
 //------------------------------------------------------------------------------
 
-JustWifi::JustWifi() {
-    _softap.ssid = NULL;
-    _timeout = 0;
-    WiFi.enableAP(false);
-    WiFi.enableSTA(false);
-    snprintf_P(_hostname, sizeof(_hostname), PSTR("ESP_%06X"), ESP.getChipId());
+JustWifi::JustWifi() : _radio(&justwifiDefaultRadio()) {
+    _init();
+}
+
+JustWifi::JustWifi(JustWifiRadio & radio) : _radio(&radio) {
+    _init();
 }
 
 JustWifi::~JustWifi() {
+    if (_radio_events_enabled) _radio->onEvent(NULL, NULL);
+    #if defined(JUSTWIFI_ENABLE_WPS)
+        if (this == _wps_instance) _wps_instance = NULL;
+    #endif
     cleanNetworks();
 }
 
@@ -60,144 +78,537 @@ JustWifi::~JustWifi() {
 // PRIVATE METHODS
 //------------------------------------------------------------------------------
 
+void JustWifi::_init() {
+    memset(_quarantine, 0, sizeof(_quarantine));
+    memset(&_queue_stats, 0, sizeof(_queue_stats));
+    memset(&_sta_rank, 0, sizeof(_sta_rank));
+    memset(&_roaming_target, 0, sizeof(_roaming_target));
+    _roaming_target.id = 0xFFFF;
+    #ifdef JUSTWIFI_ENABLE_METRICS
+        resetMetrics();
+    #endif
+    memset(&_softap, 0, sizeof(_softap));
+    _timeout = 0;
+    _radio->enableAP(false);
+    _radio->enableSTA(false);
+    snprintf_P(_hostname, sizeof(_hostname), PSTR("ESP_%06X"), _radio->chipId());
+
+    // Spread the chip ID bits so neighbouring IDs do not get similar sequences
+    _backoff_random = _jw_crc32(_hostname, strlen(_hostname)) | 1;
+}
+
 void JustWifi::_disable() {
 
     // See https://github.com/esp8266/Arduino/issues/2186
-    if (strncmp_P(ESP.getSdkVersion(), PSTR("1.5.3"), 5) == 0) {
-        if ((WiFi.getMode() & WIFI_AP) > 0) {
-            WiFi.mode(WIFI_OFF);
-            delay(10);
-            WiFi.enableAP(true);
+    if (strncmp_P(_radio->sdkVersion(), PSTR("1.5.3"), 5) == 0) {
+        if ((_radio->getMode() & WIFI_AP) > 0) {
+            _radio->mode(WIFI_OFF);
+            _radio->delay(10);
+            _radio->enableAP(true);
         } else {
-            WiFi.mode(WIFI_OFF);
+            _radio->mode(WIFI_OFF);
         }
 
     }
 
 }
-uint8_t JustWifi::_sortByRSSI() {
+bool JustWifi::_fastLoad() {
+
+    if (_fast_buffer) {
+        memcpy(&_fast_data, _fast_buffer, sizeof(_fast_data));
+    } else if (!_radio->rtcRead(JUSTWIFI_FAST_CONNECT_RTC_OFFSET, (uint32_t *) &_fast_data, sizeof(_fast_data))) {
+        return false;
+    }
+
+    if (_fast_data.version != JUSTWIFI_FAST_CONNECT_VERSION) return false;
+    uint32_t crc = _jw_crc32(((uint8_t *) &_fast_data) + sizeof(_fast_data.crc), sizeof(_fast_data) - sizeof(_fast_data.crc));
+    return (crc == _fast_data.crc);
+
+}
+
+void JustWifi::_fastSave(network_t * entry) {
+
+    _fast_data.network = _jw_crc32(entry->ssid, strlen(entry->ssid));
+    if (entry->pass[0]) _fast_data.network = _jw_crc32(entry->pass, strlen(entry->pass), _fast_data.network);
+    _fast_data.ip = _radio->localIP();
+    _fast_data.gw = _radio->gatewayIP();
+    _fast_data.netmask = _radio->subnetMask();
+    _fast_data.dns = _radio->dnsIP();
+    memcpy(_fast_data.bssid, _radio->BSSID(), sizeof(_fast_data.bssid));
+    _fast_data.channel = _radio->channel();
+    _fast_data.version = JUSTWIFI_FAST_CONNECT_VERSION;
+    _fast_data.crc = _jw_crc32(((uint8_t *) &_fast_data) + sizeof(_fast_data.crc), sizeof(_fast_data) - sizeof(_fast_data.crc));
+
+    if (_fast_buffer) {
+        memcpy(_fast_buffer, &_fast_data, sizeof(_fast_data));
+    } else {
+        _radio->rtcWrite(JUSTWIFI_FAST_CONNECT_RTC_OFFSET, (uint32_t *) &_fast_data, sizeof(_fast_data));
+    }
+
+}
 
-    bool first = true;
-    uint8_t bestID = 0xFF;
+// Looks for the network in the fast reconnect data,
+// if found it becomes the only entry in the ranking
+bool JustWifi::_fastFind() {
 
-    for (uint8_t i = 0; i < _network_list.size(); i++) {
+    if (!_fastLoad()) return false;
 
+    for (uint16_t i = 0; i < _network_list.size(); i++) {
         network_t * entry = &_network_list[i];
+        uint32_t network = _jw_crc32(entry->ssid, strlen(entry->ssid));
+        if (entry->pass[0]) network = _jw_crc32(entry->pass, strlen(entry->pass), network);
+        if (network == _fast_data.network) {
+            // Also a hint for targeted scans if the fast path fails
+            entry->channel = _fast_data.channel;
+            justwifi_rank_t rank = { 0, 0, i, 0xFFFF };
+            _ranking.assign(1, rank);
+            _rank_index = 0;
+            return true;
+        }
+    }
+
+    return false;
 
-        // if no data skip
-        if (entry->rssi == 0) continue;
+}
 
-        // Empty list
-        if (first) {
-            first = false;
-            bestID = i;
-            entry->next = 0xFF;
+// Derives the PMK of the pending networks a few iterations at a time,
+// only while the state machine is waiting for the radio or the next retry
+void JustWifi::_pmkLoop() {
+
+    if (!_pmk_enabled) return;
+    if ((_state != STATE_IDLE) && (_state != STATE_SCAN_ONGOING) && (_state != STATE_STA_ONGOING)) return;
+
+    // Look for the next network
+    if (0xFFFF == _pmk_id) {
+
+        if (!_pmk_pending) return;
+        _pmk_pending = false;
+
+        for (uint16_t i = 0; i < _network_list.size(); i++) {
+            network_t * entry = &_network_list[i];
+            if (entry->pmk_ready || !entry->pass[0]) continue;
+            #ifdef JUSTWIFI_ENABLE_ENTERPRISE
+            if (entry->enterprise_username[0]) continue;
+            #endif
+            size_t len = strlen(entry->pass);
+            if ((len < 8) || (len > 63)) continue;
+            _pmk_job.begin(entry->pass, (const uint8_t *) entry->ssid, strlen(entry->ssid));
+            _pmk_id = i;
+            _pmk_pending = true;
+            break;
+        }
 
-        // The best so far
-        } else if (entry->rssi > _network_list[bestID].rssi) {
-            entry->next = bestID;
-            bestID = i;
+        if (0xFFFF == _pmk_id) return;
 
-        // Walk the list
-        } else {
+    }
 
-            network_t * current = &_network_list[bestID];
-            while (current->next != 0xFF) {
-                if (entry->rssi > _network_list[current->next].rssi) {
-                    entry->next = current->next;
-                    current->next = i;
-                    break;
-                }
-                current = &_network_list[current->next];
+    if (_pmk_job.step(JUSTWIFI_PMK_ITERATIONS_PER_LOOP)) {
+        network_t * entry = &_network_list[_pmk_id];
+        _pmk_job.get(entry->pmk);
+        entry->pmk_ready = true;
+        _pmk_id = 0xFFFF;
+    }
+
+}
+
+justwifi_quarantine_t * JustWifi::_quarantineFind(const uint8_t * bssid) {
+    for (uint8_t i = 0; i < JUSTWIFI_QUARANTINE_SIZE; i++) {
+        justwifi_quarantine_t * slot = &_quarantine[i];
+        if ((slot->failures > 0) && (memcmp(slot->bssid, bssid, sizeof(slot->bssid)) == 0)) return slot;
+    }
+    return NULL;
+}
+
+bool JustWifi::_quarantined(const uint8_t * bssid) {
+    if (!_quarantine_enabled) return false;
+    justwifi_quarantine_t * slot = _quarantineFind(bssid);
+    if (!slot) return false;
+    unsigned long penalty = (unsigned long) JUSTWIFI_QUARANTINE_PENALTY << (slot->failures - 1);
+    return (_radio->millis() - slot->last < penalty);
+}
+
+void JustWifi::_quarantineFail(const uint8_t * bssid) {
+
+    if (!_quarantine_enabled) return;
+
+    unsigned long now = _radio->millis();
+    justwifi_quarantine_t * slot = _quarantineFind(bssid);
+
+    // Decay the failure count
+    if (slot) {
+        unsigned long periods = (now - slot->last) / JUSTWIFI_QUARANTINE_DECAY;
+        slot->failures = (periods >= 8) ? 0 : (slot->failures >> periods);
+
+    // Take a free slot or the least recently failed one
+    } else {
+        slot = &_quarantine[0];
+        for (uint8_t i = 0; i < JUSTWIFI_QUARANTINE_SIZE; i++) {
+            if (0 == _quarantine[i].failures) {
+                slot = &_quarantine[i];
+                break;
             }
+            if (now - _quarantine[i].last > now - slot->last) slot = &_quarantine[i];
+        }
+        memcpy(slot->bssid, bssid, sizeof(slot->bssid));
+        slot->failures = 0;
+    }
+
+    if (slot->failures < JUSTWIFI_QUARANTINE_MAX_FAILURES) slot->failures++;
+    slot->last = now;
+
+}
+
+void JustWifi::_quarantineClear(const uint8_t * bssid) {
+    justwifi_quarantine_t * slot = _quarantineFind(bssid);
+    if (slot) slot->failures = 0;
+}
+
+// Weighted score of an access point (or of the network alone if rssi is 0),
+// quarantined access points always go after the healthy ones
+int16_t JustWifi::_score(const network_t * entry, int8_t rssi, bool quarantined) {
+
+    const justwifi_stats_t & stats = entry->stats;
+
+    // Each term goes from 0 to 100
+    int32_t signal = 0;
+    if (rssi && stats.rssi) {
+        signal = (16 * rssi + stats.rssi) / 32 + 100;
+    } else if (rssi) {
+        signal = rssi + 100;
+    } else if (stats.rssi) {
+        signal = stats.rssi / 16 + 100;
+    }
+    signal = constrain(signal, 0, 100);
+    int32_t success = (100 * stats.success) / 255;
+    int32_t time = (stats.time < 10000) ? stats.time / 100 : 100;
+
+    int32_t score = _score_rssi * signal + _score_success * success - _score_time * time;
+    score = constrain(score, -0x3FFF, 0x3FFF);
+    return quarantined ? score - 0x4000 : score;
+
+}
+
+// Averages the outcome of an attempt into the network history,
+// time is 0 when it does not tell how long the network takes
+// (like fast reconnects, that skip DHCP). For failed attempts
+// it is the deadline that expired, 0 if it did not time out.
+void JustWifi::_learn(network_t * entry, bool success, unsigned long time) {
+
+    justwifi_stats_t & stats = entry->stats;
+
+    if (!success) {
+
+        stats.success -= (stats.success + 3) / 4;
 
-            // Place it the last
-            if (current->next == 0xFF) {
-                current->next = i;
-                entry->next = 0xFF;
+        // Timed out, back off like the TCP retransmission timer: the
+        // deviation grows so the next deadline doubles, successful
+        // attempts bring it back down
+        if (time && stats.time) {
+            uint32_t deadline = 2 * time;
+            uint32_t floor = (uint32_t) stats.time + 4UL * stats.deviation + JUSTWIFI_TIMEOUT_MARGIN;
+            if (deadline > floor) {
+                uint32_t deviation = (deadline - stats.time - JUSTWIFI_TIMEOUT_MARGIN) / 4;
+                stats.deviation = (deviation > 0xFFFF) ? 0xFFFF : deviation;
             }
+        }
+        return;
+
+    }
+
+    stats.success += (255 - stats.success + 3) / 4;
+    if (0 == time) return;
+
+    // Same estimator as the TCP retransmission timeout
+    if (time > 0xFFFF) time = 0xFFFF;
+    if (0 == stats.time) {
+        stats.time = time;
+        stats.deviation = time / 2;
+    } else {
+        uint32_t error = (time > stats.time) ? time - stats.time : stats.time - time;
+        if (error > 0xFFFF) error = 0xFFFF;
+        stats.deviation = ((uint32_t) 3 * stats.deviation + error) / 4;
+        stats.time = ((uint32_t) 3 * stats.time + time) / 4;
+    }
+
+}
+
+// Time to wait for an attempt to the given network
+unsigned long JustWifi::_deadline(const network_t * entry) {
+
+    if (!_adaptive_timeout) return _connect_timeout;
+
+    // No history yet, enterprise authentication takes longer
+    const justwifi_stats_t & stats = entry->stats;
+    if (0 == stats.time) {
+        #ifdef JUSTWIFI_ENABLE_ENTERPRISE
+            if (entry->enterprise_username[0]) return (_timeout_max > _connect_timeout) ? _timeout_max : _connect_timeout;
+        #endif
+        return _connect_timeout;
+    }
+
+    unsigned long deadline = stats.time + 4UL * stats.deviation + JUSTWIFI_TIMEOUT_MARGIN;
+    return constrain(deadline, _timeout_min, _timeout_max);
 
+}
+
+// Builds the connection order. Scanned access points are grouped by network,
+// networks go by their best access point and each network is exhausted
+// (up to JUSTWIFI_MAX_BSSIDS access points) before moving to the next one.
+// Without scan data networks go by their history alone.
+// Scores come from _score(), then priority and list order break ties.
+// Only the ranking is rewritten so it can be rebuilt at any time.
+void JustWifi::_rank() {
+
+    _ranking.clear();
+
+    auto order = [this](const justwifi_rank_t & a, const justwifi_rank_t & b) {
+        if (a.network_score != b.network_score) return a.network_score > b.network_score;
+        if (a.id != b.id) {
+            uint8_t pa = _network_list[a.id].priority;
+            uint8_t pb = _network_list[b.id].priority;
+            if (pa != pb) return pa > pb;
+            return a.id < b.id;
         }
+        return a.score > b.score;
+    };
+
+    if (!_scan) {
+        _ranking.reserve(_network_list.size());
+        for (uint16_t i = 0; i < _network_list.size(); i++) {
+            int16_t score = _score(&_network_list[i], 0, false);
+            justwifi_rank_t rank = { score, score, i, 0xFFFF };
+            _ranking.push_back(rank);
+        }
+        std::sort(_ranking.begin(), _ranking.end(), order);
+        return;
+    }
 
+    _ranking.reserve(_candidates.size());
+    for (uint16_t i = 0; i < _candidates.size(); i++) {
+        justwifi_bssid_t * candidate = &_candidates[i];
+        candidate->quarantined = _quarantined(candidate->bssid);
+        int16_t score = _score(&_network_list[candidate->id], candidate->rssi, candidate->quarantined);
+        justwifi_rank_t rank = { 0, score, candidate->id, i };
+        _ranking.push_back(rank);
     }
 
-    return bestID;
+    // Group by network, best first
+    std::sort(_ranking.begin(), _ranking.end(), [](const justwifi_rank_t & a, const justwifi_rank_t & b) {
+        if (a.id != b.id) return a.id < b.id;
+        return a.score > b.score;
+    });
+
+    // Score each network by its first access point and drop the extra ones
+    uint16_t count = 0;
+    uint8_t bssids = 0;
+    int16_t best = 0;
+    for (uint16_t i = 0; i < _ranking.size(); i++) {
+        if ((0 == i) || (_ranking[i].id != _ranking[i - 1].id)) {
+            bssids = 0;
+            best = _ranking[i].score;
+        }
+        if (bssids++ >= JUSTWIFI_MAX_BSSIDS) continue;
+        _ranking[count] = _ranking[i];
+        _ranking[count].network_score = best;
+        count++;
+    }
+    _ranking.resize(count);
+
+    std::sort(_ranking.begin(), _ranking.end(), order);
 
 }
 
-String JustWifi::_encodingString(uint8_t security) {
-    if (security == ENC_TYPE_WEP) return String("WEP ");
-    if (security == ENC_TYPE_TKIP) return String("WPA ");
-    if (security == ENC_TYPE_CCMP) return String("WPA2");
-    if (security == ENC_TYPE_AUTO) return String("AUTO");
-    return String("OPEN");
+const char * JustWifi::_encodingString(uint8_t security) {
+    if (security == ENC_TYPE_WEP) return "WEP ";
+    if (security == ENC_TYPE_TKIP) return "WPA ";
+    if (security == ENC_TYPE_CCMP) return "WPA2";
+    if (security == ENC_TYPE_AUTO) return "AUTO";
+    return "OPEN";
 }
 
-uint8_t JustWifi::_populate(uint8_t networkCount) {
+// WEP keys are 5 or 13 characters or 10 or 26 hex digits,
+// some of them are valid WPA passphrases too
+static bool _jw_wep_key(const char * pass) {
+    size_t len = strlen(pass);
+    if ((5 == len) || (13 == len)) return true;
+    if ((10 != len) && (26 != len)) return false;
+    for (uint8_t i = 0; i < len; i++) {
+        if (!isxdigit(pass[i])) return false;
+    }
+    return true;
+}
 
-    uint8_t count = 0;
+// FNV-1a
+static uint32_t _jw_hash(const uint8_t * data, uint8_t length) {
+    uint32_t hash = 2166136261UL;
+    while (length--) {
+        hash ^= *data++;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+// Open addressing table over the network list, at most half full,
+// networks sharing an SSID are stored in list order
+void JustWifi::_buildIndex() {
+
+    size_t size = 4;
+    while (size < 2 * _network_list.size()) size <<= 1;
 
-    // Reset RSSI to disable networks that have disappeared
-    for (uint8_t j = 0; j < _network_list.size(); j++) {
-        _network_list[j].rssi = 0;
-        _network_list[j].scanned = false;
+    justwifi_ssid_index_t empty = { 0, 0, 0xFFFF };
+    _ssid_index.assign(size, empty);
+
+    for (uint16_t i = 0; i < _network_list.size(); i++) {
+        uint8_t length = strlen(_network_list[i].ssid);
+        uint32_t hash = _jw_hash((const uint8_t *) _network_list[i].ssid, length);
+        size_t slot = hash & (size - 1);
+        while (_ssid_index[slot].id != 0xFFFF) slot = (slot + 1) & (size - 1);
+        _ssid_index[slot].hash = hash;
+        _ssid_index[slot].length = length;
+        _ssid_index[slot].id = i;
     }
 
-    String ssid_scan;
-    int32_t rssi_scan;
-    uint8_t sec_scan;
-    uint8_t* BSSID_scan;
-    int32_t chan_scan;
-    bool hidden_scan;
+    _ssid_index_dirty = false;
 
-    // Populate defined networks with scan data
-    for (int8_t i = 0; i < networkCount; ++i) {
+}
 
-        WiFi.getNetworkInfo(i, ssid_scan, sec_scan, rssi_scan, BSSID_scan, chan_scan, hidden_scan);
+network_t * JustWifi::_findNetwork(const uint8_t * ssid, uint8_t length, uint8_t security) {
 
-        bool known = false;
+    if (_ssid_index_dirty) _buildIndex();
 
-        for (uint8_t j = 0; j < _network_list.size(); j++) {
+    uint32_t hash = _jw_hash(ssid, length);
+    size_t mask = _ssid_index.size() - 1;
+    size_t slot = hash & mask;
 
-            network_t * entry = &_network_list[j];
+    for (; _ssid_index[slot].id != 0xFFFF; slot = (slot + 1) & mask) {
 
-            if (ssid_scan.equals(entry->ssid)) {
+        justwifi_ssid_index_t * index = &_ssid_index[slot];
+        if ((index->hash != hash) || (index->length != length)) continue;
 
-                // Check security
-                if ((sec_scan != ENC_TYPE_NONE) && (entry->pass == NULL)) continue;
+        network_t * entry = &_network_list[index->id];
+        if (memcmp(entry->ssid, ssid, length) != 0) continue;
 
-                // In case of several networks with the same SSID
-                // we want to get the one with the best RSSI
-                // Thanks to Robert (robi772 @ bitbucket.org)
-                if (entry->rssi < rssi_scan || entry->rssi == 0) {
-                    entry->rssi = rssi_scan;
-                    entry->security = sec_scan;
-                    entry->channel = chan_scan;
-                    entry->scanned = true;
-                    memcpy((void*) &entry->bssid, (void*) BSSID_scan, sizeof(entry->bssid));
-                }
+        // Check security
+        if ((security != ENC_TYPE_NONE) && (entry->pass[0] == 0x00)) continue;
 
-                count++;
-                known = true;
-                break;
+        return entry;
+
+    }
+
+    return NULL;
+
+}
+
+// Same SSID and password, there can be several entries with the same SSID
+network_t * JustWifi::_findSame(const network_t & network) {
+
+    if (_ssid_index_dirty) _buildIndex();
+
+    uint8_t length = strlen(network.ssid);
+    uint32_t hash = _jw_hash((const uint8_t *) network.ssid, length);
+    size_t mask = _ssid_index.size() - 1;
+    size_t slot = hash & mask;
+
+    for (; _ssid_index[slot].id != 0xFFFF; slot = (slot + 1) & mask) {
+
+        justwifi_ssid_index_t * index = &_ssid_index[slot];
+        if ((index->hash != hash) || (index->length != length)) continue;
+
+        network_t * entry = &_network_list[index->id];
+        if (memcmp(entry->ssid, network.ssid, length) != 0) continue;
+        if (strcmp(entry->pass, network.pass) != 0) continue;
+
+        return entry;
+
+    }
+
+    return NULL;
+
+}
+
+uint8_t JustWifi::_populate(uint8_t networkCount) {
 
+    uint8_t count = 0;
+
+    // Populate defined networks with scan data
+    justwifi_scan_result_t result;
+    for (uint8_t i = 0; i < networkCount; ++i) {
+
+        if (!_radio->getScanResult(i, result)) continue;
+
+        // Hidden access points show up without SSID
+        if (result.hidden || (0 == result.ssid_len)) {
+            if (result.channel < 16) _scan_hidden |= (1 << result.channel);
+        }
+
+        // One hash probe per result
+        network_t * entry = _findNetwork(result.ssid, result.ssid_len, result.security);
+
+        // Probes can also be answered by access points already
+        // found by the broadcast scan
+        bool duplicate = false;
+        if (entry && _probing) {
+            for (uint16_t j = 0; j < _candidates.size(); j++) {
+                if (memcmp(_candidates[j].bssid, result.bssid, 6) == 0) {
+                    duplicate = true;
+                    break;
+                }
+            }
+        }
+
+        if (entry && !duplicate) {
+
+            // In case of several networks with the same SSID
+            // we keep all of them to try them in order
+            // Thanks to Robert (robi772 @ bitbucket.org)
+            justwifi_bssid_t candidate;
+            memcpy(candidate.bssid, result.bssid, sizeof(candidate.bssid));
+            candidate.channel = result.channel;
+            candidate.security = result.security;
+            candidate.rssi = result.rssi;
+            candidate.quarantined = false;
+            candidate.id = entry - _network_list.data();
+            entry->channel = result.channel;
+
+            // Up to JUSTWIFI_MAX_BSSIDS per network, a stronger access point
+            // replaces the weakest one so dense scans do not grow the list
+            uint8_t bssids = 0;
+            uint16_t weakest = 0xFFFF;
+            for (uint16_t j = 0; j < _candidates.size(); j++) {
+                if (_candidates[j].id != candidate.id) continue;
+                bssids++;
+                if ((0xFFFF == weakest) || (_candidates[j].rssi < _candidates[weakest].rssi)) weakest = j;
+            }
+            if (bssids < JUSTWIFI_MAX_BSSIDS) {
+                _candidates.push_back(candidate);
+            } else if (candidate.rssi > _candidates[weakest].rssi) {
+                _candidates[weakest] = candidate;
             }
 
+            justwifi_stats_t & stats = entry->stats;
+            stats.rssi = stats.rssi ? stats.rssi + (16 * result.rssi - stats.rssi) / 8 : 16 * result.rssi;
+            count++;
+
         }
 
-		{
-		    char buffer[128];
-		    sprintf_P(buffer,
-		        PSTR("%s BSSID: %02X:%02X:%02X:%02X:%02X:%02X CH: %2d RSSI: %3d SEC: %s SSID: %s"),
-		        (known ? "-->" : "   "),
-		        BSSID_scan[0], BSSID_scan[1], BSSID_scan[2], BSSID_scan[3], BSSID_scan[4], BSSID_scan[5],
-		        chan_scan,
-                rssi_scan,
-                _encodingString(sec_scan).c_str(),
-		        ssid_scan.c_str()
-		    );
-		    _doCallback(MESSAGE_FOUND_NETWORK, buffer);
-		}
+        if (_listening(MESSAGE_FOUND_NETWORK)) {
+
+            char ssid[JUSTWIFI_SSID_SIZE + 1];
+            memcpy(ssid, result.ssid, result.ssid_len);
+            ssid[result.ssid_len] = 0x00;
+
+            justwifi_event_t event;
+            memset(&event, 0, sizeof(event));
+            event.message = MESSAGE_FOUND_NETWORK;
+            event.ssid = ssid;
+            event.bssid = result.bssid;
+            event.rssi = result.rssi;
+            event.channel = result.channel;
+            event.security = result.security;
+            event.known = (entry != NULL);
+            _doEvent(event);
+
+        }
 
     }
 
@@ -205,58 +616,82 @@ uint8_t JustWifi::_populate(uint8_t networkCount) {
 
 }
 
-uint8_t JustWifi::_doSTA(uint8_t id) {
-
-    static uint8_t networkID;
-    static uint8_t state = RESPONSE_START;
-    static unsigned long timeout;
+uint8_t JustWifi::_doSTA(justwifi_rank_t * rank) {
 
     // Reset connection process
-    if (id != 0xFF) {
-        state = RESPONSE_START;
-        networkID = id;
+    if (rank) {
+        _sta_state = RESPONSE_START;
+        _sta_rank = *rank;
     }
 
-    // Get network
-    network_t entry = _network_list[networkID];
+    // Network list changed under our feet
+    if (_sta_rank.id >= _network_list.size()) return (_sta_state = RESPONSE_FAIL);
+
+    // Get network and access point
+    network_t * entry = &_network_list[_sta_rank.id];
+    justwifi_bssid_t * candidate = NULL;
+    if (_sta_rank.candidate < _candidates.size()) candidate = &_candidates[_sta_rank.candidate];
 
     // No state or previous network failed
-    if (RESPONSE_START == state) {
+    if (RESPONSE_START == _sta_state) {
+
+        // Use the cached PMK (as 64 hex digits) so the stack skips the PBKDF2,
+        // only for WPA networks: a key that could be WEP goes as it is unless
+        // the scan says otherwise
+        const char * pass = entry->pass[0] ? entry->pass : NULL;
+        char psk[2 * JUSTWIFI_PMK_SIZE + 1];
+        bool wpa = candidate
+            ? ((ENC_TYPE_TKIP == candidate->security) || (ENC_TYPE_CCMP == candidate->security) || (ENC_TYPE_AUTO == candidate->security))
+            : !_jw_wep_key(entry->pass);
+        if (_pmk_enabled && entry->pmk_ready && wpa) {
+            for (uint8_t i = 0; i < JUSTWIFI_PMK_SIZE; i++) {
+                snprintf_P(&psk[2*i], 3, PSTR("%02x"), entry->pmk[i]);
+            }
+            pass = psk;
+        }
 
-        WiFi.persistent(false);
+        _radio->persistent(false);
         _disable();
-        WiFi.enableSTA(true);
-        WiFi.hostname(_hostname);
-
-        // Configure static options
-        if (!entry.dhcp) {
-            WiFi.config(entry.ip, entry.gw, entry.netmask, entry.dns);
+        _radio->enableSTA(true);
+        _radio->hostname(_hostname);
+
+        // Configure static options,
+        // the fast path reuses the last lease as a static configuration
+        if (_fast) {
+            _radio->config(_fast_data.ip, _fast_data.gw, _fast_data.netmask, _fast_data.dns);
+            _fast_static = true;
+        } else if (!entry->dhcp) {
+            _radio->config(entry->ip, entry->gw, entry->netmask, entry->dns);
+        } else if (_fast_static) {
+            _radio->config(IPAddress(), IPAddress(), IPAddress(), IPAddress());
+            _fast_static = false;
         }
 
         // Connect
-		{
-            char buffer[128];
-            if (entry.scanned) {
-                snprintf_P(buffer, sizeof(buffer),
-                    PSTR("BSSID: %02X:%02X:%02X:%02X:%02X:%02X CH: %02d, RSSI: %3d, SEC: %s, SSID: %s"),
-                    entry.bssid[0], entry.bssid[1], entry.bssid[2], entry.bssid[3], entry.bssid[4], entry.bssid[5],
-                    entry.channel,
-                    entry.rssi,
-                    _encodingString(entry.security).c_str(),
-                    entry.ssid
-                );
-            } else {
-                snprintf_P(buffer, sizeof(buffer), PSTR("SSID: %s"), entry.ssid);
+        {
+            justwifi_event_t event;
+            memset(&event, 0, sizeof(event));
+            event.message = MESSAGE_CONNECTING;
+            event.ssid = entry->ssid;
+            if (_fast) {
+                event.bssid = _fast_data.bssid;
+                event.channel = _fast_data.channel;
+                event.fast = true;
+            } else if (candidate) {
+                event.bssid = candidate->bssid;
+                event.channel = candidate->channel;
+                event.rssi = candidate->rssi;
+                event.security = candidate->security;
             }
-		    _doCallback(MESSAGE_CONNECTING, buffer);
+            _doEvent(event);
         }
 
         #ifdef JUSTWIFI_ENABLE_ENTERPRISE
-        if (entry.enterprise_username && entry.enterprise_password) {
+        if (entry->enterprise_username[0] && entry->enterprise_password[0]) {
             // Create config
             struct station_config wifi_config;
             memset(&wifi_config, 0, sizeof(wifi_config));
-            strcpy((char*)wifi_config.ssid, entry.ssid);
+            strcpy((char*)wifi_config.ssid, entry->ssid);
             wifi_config.bssid_set = 0;
             *wifi_config.password = 0;
 
@@ -269,9 +704,9 @@ uint8_t JustWifi::_doSTA(uint8_t id) {
             wifi_station_set_wpa2_enterprise_auth(1);
 
             // Set user/pass
-            wifi_station_set_enterprise_identity((uint8*)entry.enterprise_username, strlen(entry.enterprise_username));
-            wifi_station_set_enterprise_username((uint8*)entry.enterprise_username, strlen(entry.enterprise_username));
-            wifi_station_set_enterprise_password((uint8*)entry.enterprise_password, strlen(entry.enterprise_password));
+            wifi_station_set_enterprise_identity((uint8*)entry->enterprise_username, strlen(entry->enterprise_username));
+            wifi_station_set_enterprise_username((uint8*)entry->enterprise_username, strlen(entry->enterprise_username));
+            wifi_station_set_enterprise_password((uint8*)entry->enterprise_password, strlen(entry->enterprise_password));
 
             // Connect, free resources after
             wifi_station_connect();
@@ -282,39 +717,90 @@ uint8_t JustWifi::_doSTA(uint8_t id) {
             wifi_station_clear_enterprise_ca_cert();
         } else
         #endif
-        if (entry.channel == 0) {
-            WiFi.begin(entry.ssid, entry.pass);
+        if (_fast) {
+            _radio->begin(entry->ssid, pass, _fast_data.channel, _fast_data.bssid);
+        } else if (candidate) {
+            _radio->begin(entry->ssid, pass, candidate->channel, candidate->bssid);
         } else {
-            WiFi.begin(entry.ssid, entry.pass, entry.channel, entry.bssid);
+            _radio->begin(entry->ssid, pass);
         }
 
-        timeout = millis();
-        return (state = RESPONSE_WAIT);
+        _reason = REASON_NONE;
+        _status = WL_DISCONNECTED;
+        _sta_timeout = _radio->millis();
+        _sta_deadline = _deadline(entry);
+        return (_sta_state = RESPONSE_WAIT);
 
     }
 
     // Connected?
-    if (WiFi.status() == WL_CONNECTED) {
+    wl_status_t status = _getStatus();
+    if (status == WL_CONNECTED) {
 
         // Autoconnect only if DHCP, since it doesn't store static IP data
-        WiFi.setAutoConnect(entry.dhcp);
+        _radio->setAutoConnect(entry->dhcp);
+
+        _radio->setAutoReconnect(true);
+
+        // Remember the connection for the next boot
+        if (_fast_enabled && !_fast) _fastSave(entry);
+
+        _learn(entry, true, _fast ? 0 : _radio->millis() - _sta_timeout);
 
-        WiFi.setAutoReconnect(true);
-        _doCallback(MESSAGE_CONNECTED);
-        return (state = RESPONSE_OK);
+        // Forgive the AP
+        if (_fast) {
+            _quarantineClear(_fast_data.bssid);
+        } else if (candidate) {
+            _quarantineClear(candidate->bssid);
+        }
+
+        justwifi_event_t event;
+        memset(&event, 0, sizeof(event));
+        event.message = MESSAGE_CONNECTED;
+        event.ssid = entry->ssid;
+        event.fast = _fast;
+        _doEvent(event);
+        return (_sta_state = RESPONSE_OK);
+
+    }
 
+    // Check definitive errors (the AP is not there or it rejected us),
+    // no point in waiting for the timeout
+    if (status == WL_NO_SSID_AVAIL) {
+        _reason = REASON_NO_SSID;
+    } else if (status == WL_CONNECT_FAILED) {
+        _reason = REASON_CONNECT_FAILED;
+    } else if (_radio->millis() - _sta_timeout > _sta_deadline) {
+        _reason = REASON_TIMEOUT;
     }
 
-    // Check timeout
-    if (millis() - timeout > _connect_timeout) {
-        WiFi.enableSTA(false);
-        _doCallback(MESSAGE_CONNECT_FAILED, entry.ssid);
-        return (state = RESPONSE_FAIL);
+    if (_reason != REASON_NONE) {
+
+        justwifi_event_t event;
+        memset(&event, 0, sizeof(event));
+        event.message = MESSAGE_CONNECT_FAILED;
+        event.ssid = entry->ssid;
+        event.reason = _reason;
+        event.fast = _fast;
+
+        _learn(entry, false, (_adaptive_timeout && (REASON_TIMEOUT == _reason)) ? _sta_deadline : 0);
+
+        if (_fast) {
+            _quarantineFail(_fast_data.bssid);
+            event.bssid = _fast_data.bssid;
+        } else if (candidate) {
+            _quarantineFail(candidate->bssid);
+            event.bssid = candidate->bssid;
+        }
+        _radio->enableSTA(false);
+        _doEvent(event);
+        return (_sta_state = RESPONSE_FAIL);
+
     }
 
     // Still waiting
     _doCallback(MESSAGE_CONNECT_WAITING);
-    return state;
+    return _sta_state;
 
 }
 
@@ -324,23 +810,24 @@ bool JustWifi::_doAP() {
     if (_ap_connected) enableAP(false);
 
     // Check if Soft AP configuration defined
-    if (!_softap.ssid) {
-        _softap.ssid = strdup(_hostname);
+    if (!_softap.ssid[0]) {
+        strncpy(_softap.ssid, _hostname, JUSTWIFI_SSID_SIZE);
+        _softap.ssid[JUSTWIFI_SSID_SIZE] = 0x00;
     }
 
     _doCallback(MESSAGE_ACCESSPOINT_CREATING);
 
-    WiFi.enableAP(true);
+    _radio->enableAP(true);
 
     // Configure static options
     if (_softap.dhcp) {
-        WiFi.softAPConfig(_softap.ip, _softap.gw, _softap.netmask);
+        _radio->softAPConfig(_softap.ip, _softap.gw, _softap.netmask);
     }
 
-    if (_softap.pass) {
-        WiFi.softAP(_softap.ssid, _softap.pass);
+    if (_softap.pass[0]) {
+        _radio->softAP(_softap.ssid, _softap.pass);
     } else {
-        WiFi.softAP(_softap.ssid);
+        _radio->softAP(_softap.ssid);
     }
 
     _doCallback(MESSAGE_ACCESSPOINT_CREATED);
@@ -352,134 +839,529 @@ bool JustWifi::_doAP() {
 
 uint8_t JustWifi::_doScan() {
 
-    static bool scanning = false;
-
     // If not scanning, start scan
-    if (false == scanning) {
-        WiFi.disconnect();
-        WiFi.enableSTA(true);
-        WiFi.scanNetworks(true, true);
+    if (!_scanning) {
+        _radio->disconnect();
+        _radio->enableSTA(true);
+        _candidates.clear();
+        _scan_cached = false;
+        _scan_results = 0;
+        _scan_hidden = 0;
+        _probing = false;
+        _scan_channels = (_targeted_scan && !_scan_sweep) ? _scanChannels() : 0;
+        _scan_sweep = false;
+        _scanNext();
         _doCallback(MESSAGE_SCANNING);
-        scanning = true;
+        _scanning = true;
         return RESPONSE_WAIT;
     }
 
     // Check if scanning
-    int8_t scanResult = WiFi.scanComplete();
+    int8_t scanResult = _radio->scanComplete();
     if (WIFI_SCAN_RUNNING == scanResult) {
         return RESPONSE_WAIT;
     }
 
-    // Scan finished
-    scanning = false;
-
     // Sometimes the scan fails,
     // this will force the scan to restart
     if (WIFI_SCAN_FAILED == scanResult) {
+        _scanning = false;
         _doCallback(MESSAGE_SCAN_FAILED);
         return RESPONSE_WAIT;
     }
 
+    // Populate network list
+    bool strong = false;
+    if (scanResult > 0) {
+        uint16_t first = _candidates.size();
+        _populate(scanResult);
+        _scan_results += scanResult;
+        if (_scan_threshold < 0) {
+            for (uint16_t i = first; i < _candidates.size(); i++) {
+                if ((_candidates[i].rssi >= _scan_threshold) && !_quarantined(_candidates[i].bssid)) strong = true;
+            }
+        }
+    }
+
+    // Free memory
+    _radio->scanDelete();
+
+    // Targeted scans go on with the next channel unless
+    // a good enough network has already shown up
+    if (_scan_channels && !strong) {
+        _scanNext();
+        return RESPONSE_WAIT;
+    }
+
+    // Nothing known on the usual channels, sweep them all
+    if (!_probing && _scan_targeted && _scan_fallback && _candidates.empty()) {
+        _scan_channels = 0;
+        _scanNext();
+        return RESPONSE_WAIT;
+    }
+
+    // Hidden networks only answer probes for their SSID
+    if (!_probing) {
+        _probing = true;
+        _probe_id = 0;
+        _probe_channels = _scan_hidden;
+    }
+    if (!strong && _scanProbe()) return RESPONSE_WAIT;
+
+    // Scan finished
+    _scanning = false;
+
     // Check networks
-    if (0 == scanResult) {
+    if (0 == _scan_results) {
         _doCallback(MESSAGE_NO_NETWORKS);
         return RESPONSE_FAIL;
     }
 
-    // Populate network list
-    uint8_t count = _populate(scanResult);
-
-    // Free memory
-    WiFi.scanDelete();
-
-    if (0 == count) {
+    if (_candidates.empty()) {
         _doCallback(MESSAGE_NO_KNOWN_NETWORKS);
         return RESPONSE_FAIL;
     }
 
-    // Sort networks by RSSI
-    _currentID = _sortByRSSI();
+    // Keep the candidates for the next connection cycles
+    _scan_cached = true;
+    _scan_time = _radio->millis();
+
+    // Rank networks by RSSI
+    _rank();
+    _rank_index = 0;
     return RESPONSE_OK;
 
 }
 
-void JustWifi::_doCallback(justwifi_messages_t message, char * parameter) {
-    for (unsigned char i=0; i < _callbacks.size(); i++) {
-        (_callbacks[i])(message, parameter);
+// Channels where known networks were last seen, bit n for channel n
+uint16_t JustWifi::_scanChannels() {
+    uint16_t channels = 0;
+    for (uint16_t i = 0; i < _network_list.size(); i++) {
+        uint8_t channel = _network_list[i].channel;
+        if ((channel > 0) && (channel < 16)) channels |= (1 << channel);
     }
+    return channels;
 }
 
-String JustWifi::_MAC2String(const unsigned char* mac) {
-    char buffer[20];
-    snprintf(
-        buffer, sizeof(buffer),
-        "%02x:%02x:%02x:%02x:%02x:%02x",
-        mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]
-    );
-    return String(buffer);
-}
+// Starts a directed probe for the next hidden network, only on the
+// channels where the broadcast scan saw access points hiding their SSID
+bool JustWifi::_scanProbe() {
 
-void JustWifi::_machine() {
+    if (0 == _scan_hidden) return false;
 
-    #if false
-        static unsigned char previous = 0xFF;
-        if (_state != previous) {
-            previous = _state;
-            Serial.printf("_state: %u, WiFi.getMode(): %u\n", _state, WiFi.getMode());
+    while (_probe_id < _network_list.size()) {
+        network_t * entry = &_network_list[_probe_id];
+        if (entry->hidden && _probe_channels) {
+            uint8_t channel = 0;
+            while (0 == (_probe_channels & (1 << channel))) channel++;
+            _probe_channels &= ~(1 << channel);
+            _radio->scanNetworks(true, true, channel, entry->ssid);
+            return true;
         }
-    #endif
+        _probe_id++;
+        _probe_channels = _scan_hidden;
+    }
 
-    switch(_state) {
+    return false;
 
-        // ---------------------------------------------------------------------
+}
 
-        case STATE_IDLE:
+// Starts the scan of the next targeted channel, lowest first,
+// or a full sweep if there are none left
+void JustWifi::_scanNext() {
+    uint8_t channel = 0;
+    if (_scan_channels) {
+        while (0 == (_scan_channels & (1 << channel))) channel++;
+        _scan_channels &= ~(1 << channel);
+    }
+    _scan_targeted = (channel > 0);
+    _radio->scanNetworks(true, true, channel);
+}
 
-            // Should we connect in STA mode?
-            if (WiFi.status() != WL_CONNECTED) {
+// Samples the RSSI while connected, true when the average is below the
+// threshold and the last roaming scan is old enough (no ping-pong)
+bool JustWifi::_roamCheck() {
 
-                if (_sta_enabled) {
-                    if (_network_list.size() > 0) {
-                        if ((0 == _timeout) || ((_reconnect_timeout > 0) && (millis() - _timeout > _reconnect_timeout))) {
-                            _currentID = 0;
-                            _state = _scan ? STATE_SCAN_START : STATE_STA_START;
-                            return;
-                        }
-                    }
-                }
+    unsigned long now = _radio->millis();
+    if (now - _roaming_sampled < JUSTWIFI_ROAMING_SAMPLE) return false;
+    _roaming_sampled = now;
 
-                // Fallback
-                if (!_ap_connected & _ap_fallback_enabled) {
-                    _state = STATE_FALLBACK;
-                }
+    // Positive values mean there is no link
+    int32_t rssi = _radio->RSSI();
+    if (rssi >= 0) return false;
+    _roaming_rssi = (_roaming_rssi == 0) ? rssi : (_roaming_rssi + rssi) / 2;
+    if (_roaming_rssi >= _roaming_threshold) return false;
 
-            }
+    if ((_roaming_scanned > 0) && (now - _roaming_scanned < _roaming_interval)) return false;
+    _roaming_scanned = now;
+    return true;
 
+}
 
-            break;
+// Scans the channels of the current network without dropping the link,
+// returns RESPONSE_OK if an access point beats the current one by
+// more than the hysteresis margin
+uint8_t JustWifi::_doRoam() {
+
+    // Start
+    if (!_roaming) {
+
+        // The network that connected, another one with the same SSID
+        // might have other credentials. By SSID only if the link was
+        // not made by the state machine (SDK autoconnect)
+        String ssid = _radio->SSID();
+        network_t * entry = NULL;
+        if ((_connected_id < _network_list.size()) && (strcmp(_network_list[_connected_id].ssid, ssid.c_str()) == 0)) {
+            entry = &_network_list[_connected_id];
+        } else {
+            entry = _findNetwork((const uint8_t *) ssid.c_str(), ssid.length(), ENC_TYPE_NONE);
+        }
+        if (!entry) return RESPONSE_FAIL;
+        _roaming_id = entry - _network_list.data();
+
+        // Current channel and the ones other access points were seen on
+        _roaming_channels = 0;
+        int32_t channel = _radio->channel();
+        if ((channel > 0) && (channel < 16)) _roaming_channels |= (1 << channel);
+        for (uint16_t i = 0; i < _candidates.size(); i++) {
+            if ((_candidates[i].id == _roaming_id) && (_candidates[i].channel < 16)) {
+                _roaming_channels |= (1 << _candidates[i].channel);
+            }
+        }
+        _roaming_channels &= ~1;
+        if (0 == _roaming_channels) return RESPONSE_FAIL;
 
-        // ---------------------------------------------------------------------
+        _roaming_target.id = 0xFFFF;
+        _roaming = true;
+        _roamNext();
+        return RESPONSE_WAIT;
 
-        case STATE_SCAN_START:
-            _doScan();
-            _state = STATE_SCAN_ONGOING;
-            break;
+    }
 
-        case STATE_SCAN_ONGOING:
-            {
-                uint8_t response = _doScan();
-                if (RESPONSE_OK == response) {
-                    _state = STATE_STA_START;
-                } else if (RESPONSE_FAIL == response) {
-                    _state = STATE_FALLBACK;
-                }
-            }
-            break;
+    // Lost the link or the network list changed meanwhile,
+    // the usual reconnection takes over
+    if ((_getStatus() != WL_CONNECTED) || (_roaming_id >= _network_list.size())) {
+        _radio->scanDelete();
+        _roaming = false;
+        return RESPONSE_FAIL;
+    }
 
-        // ---------------------------------------------------------------------
+    int8_t scanResult = _radio->scanComplete();
+    if (WIFI_SCAN_RUNNING == scanResult) return RESPONSE_WAIT;
+    if (WIFI_SCAN_FAILED == scanResult) {
+        _roaming = false;
+        return RESPONSE_FAIL;
+    }
 
-        case STATE_STA_START:
-            _doSTA(_currentID);
+    // Keep the strongest access point of the network but the current one
+    network_t * entry = &_network_list[_roaming_id];
+    uint8_t length = strlen(entry->ssid);
+    const uint8_t * current = _radio->BSSID();
+    justwifi_scan_result_t result;
+    for (int8_t i = 0; i < scanResult; i++) {
+        if (!_radio->getScanResult(i, result)) continue;
+        if ((result.ssid_len != length) || (memcmp(result.ssid, entry->ssid, length) != 0)) continue;
+        if ((ENC_TYPE_NONE == result.security) != (0 == entry->pass[0])) continue;
+        if (current && (memcmp(result.bssid, current, 6) == 0)) continue;
+        if (_quarantined(result.bssid)) continue;
+        if ((0xFFFF != _roaming_target.id) && (result.rssi <= _roaming_target.rssi)) continue;
+        memcpy(_roaming_target.bssid, result.bssid, 6);
+        _roaming_target.channel = result.channel;
+        _roaming_target.security = result.security;
+        _roaming_target.rssi = result.rssi;
+        _roaming_target.quarantined = false;
+        _roaming_target.id = _roaming_id;
+    }
+    _radio->scanDelete();
+
+    if (_roaming_channels) {
+        _roamNext();
+        return RESPONSE_WAIT;
+    }
+    _roaming = false;
+
+    if (0xFFFF == _roaming_target.id) return RESPONSE_FAIL;
+    if (_roaming_target.rssi < _roaming_rssi + _roaming_hysteresis) return RESPONSE_FAIL;
+    return RESPONSE_OK;
+
+}
+
+// Directed scan of the next roaming channel, lowest first
+void JustWifi::_roamNext() {
+    uint8_t channel = 0;
+    while (0 == (_roaming_channels & (1 << channel))) channel++;
+    _roaming_channels &= ~(1 << channel);
+    _radio->scanNetworks(true, true, channel, _network_list[_roaming_id].ssid);
+}
+
+// Ranks the better access point first and the current one second,
+// so a failed reassociation goes back to where it was
+void JustWifi::_roamSwitch() {
+
+    justwifi_bssid_t current;
+    const uint8_t * bssid = _radio->BSSID();
+    if (bssid) memcpy(current.bssid, bssid, 6);
+    current.channel = _radio->channel();
+    current.security = _roaming_target.security;
+    current.rssi = _roaming_rssi;
+    current.quarantined = false;
+    current.id = _roaming_id;
+
+    _candidates.clear();
+    _candidates.push_back(_roaming_target);
+    if (bssid) _candidates.push_back(current);
+    _scan_cached = false;
+
+    _ranking.clear();
+    for (uint16_t i = 0; i < _candidates.size(); i++) {
+        justwifi_rank_t rank;
+        rank.network_score = 0;
+        rank.score = 0;
+        rank.id = _roaming_id;
+        rank.candidate = i;
+        _ranking.push_back(rank);
+    }
+    _rank_index = 0;
+
+    justwifi_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.message = MESSAGE_ROAMING;
+    event.ssid = _network_list[_roaming_id].ssid;
+    event.bssid = _roaming_target.bssid;
+    event.channel = _roaming_target.channel;
+    event.rssi = _roaming_target.rssi;
+    event.security = _roaming_target.security;
+    _doEvent(event);
+
+}
+
+#if defined(JUSTWIFI_ENABLE_WPS)
+void JustWifi::_onWPS(wps_cb_status status) {
+    if (_wps_instance) _wps_instance->_wps_status = status;
+}
+#endif
+
+// Called by the radio backend, possibly from the SDK context,
+// so it only flags the status as outdated
+void JustWifi::_onRadioEvent(justwifi_radio_event_t event, void * context) {
+    ((JustWifi *) context)->_radio_events |= (1 << event);
+}
+
+// With radio events the status is only read when the radio reported
+// something or every JUSTWIFI_EVENT_POLL_INTERVAL ms
+wl_status_t JustWifi::_getStatus() {
+    if (_radio_events_enabled) {
+        unsigned long now = _radio->millis();
+        if ((0 == _radio_events) && (now - _status_polled < JUSTWIFI_EVENT_POLL_INTERVAL)) return _status;
+        #ifdef JUSTWIFI_ENABLE_METRICS
+            if ((_radio_events & (1 << RADIO_EVENT_CONNECTED)) && (STATE_STA_ONGOING == _state)) {
+                _metricsRecord(_metrics.link, now - _metrics.entered[STATE_STA_ONGOING]);
+            }
+        #endif
+        _radio_events = 0;
+        _status_polled = now;
+    }
+    _status = _radio->status();
+    return _status;
+}
+
+// Candidates from a scan younger than the TTL are reused as they are,
+// only their ranking is updated (quarantine might have changed)
+bool JustWifi::_scanNeeded() {
+    if (!_scan) return false;
+    if (!_scan_cached || (0 == _scan_ttl)) return true;
+    return (_radio->millis() - _scan_time >= _scan_ttl);
+}
+
+bool JustWifi::_listening(justwifi_messages_t message) {
+    return (_mask & JUSTWIFI_MESSAGE_MASK(message)) > 0;
+}
+
+uint16_t JustWifi::_subscribe(subscription_t & subscription) {
+    if (++_subscription_id == 0) _subscription_id = 1;
+    subscription.id = _subscription_id;
+    if (!subscription.callback) subscription.context = NULL;
+    _subscriptions.push_back(subscription);
+    _updateMasks();
+    return subscription.id;
+}
+
+void JustWifi::_updateMasks() {
+    _mask = 0;
+    _text_mask = 0;
+    for (unsigned char i=0; i < _subscriptions.size(); i++) {
+        _mask |= _subscriptions[i].mask;
+        if (_subscriptions[i].message_fn) _text_mask |= _subscriptions[i].mask;
+    }
+}
+
+void JustWifi::_doCallback(justwifi_messages_t message) {
+    if (!_listening(message)) return;
+    justwifi_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.message = message;
+    _doEvent(event);
+}
+
+void JustWifi::_doEvent(const justwifi_event_t & event) {
+    if (!_listening(event.message)) return;
+    if (_queue_enabled) {
+        _enqueue(event);
+    } else {
+        _deliver(event);
+    }
+}
+
+void JustWifi::_enqueue(const justwifi_event_t & event) {
+
+    uint16_t size = _queue.size();
+
+    // Consecutive CONNECT_WAITING messages carry no news
+    if ((MESSAGE_CONNECT_WAITING == event.message) && (_queue_stats.count > 0)) {
+        uint16_t last = (_queue_head + _queue_stats.count - 1) % size;
+        if (MESSAGE_CONNECT_WAITING == _queue[last].event.message) return;
+    }
+
+    if (_queue_stats.count == size) {
+        _queue_stats.dropped++;
+        return;
+    }
+
+    queued_event_t * queued = &_queue[(_queue_head + _queue_stats.count) % size];
+    queued->event = event;
+    if (event.ssid) {
+        strncpy(queued->ssid, event.ssid, JUSTWIFI_SSID_SIZE);
+        queued->ssid[JUSTWIFI_SSID_SIZE] = 0x00;
+    }
+    if (event.bssid) memcpy(queued->bssid, event.bssid, sizeof(queued->bssid));
+
+    _queue_stats.queued++;
+    _queue_stats.count++;
+    if (_queue_stats.count > _queue_stats.peak) _queue_stats.peak = _queue_stats.count;
+
+}
+
+void JustWifi::_deliver(const justwifi_event_t & event) {
+
+    uint32_t bit = JUSTWIFI_MESSAGE_MASK(event.message);
+
+    // Text is only built for the message subscribers
+    char buffer[128];
+    char * parameter = NULL;
+    if ((_text_mask & bit) && (formatEvent(event, buffer, sizeof(buffer)) > 0)) {
+        parameter = buffer;
+    }
+
+    _dispatching = true;
+    for (unsigned char i=0; i < _subscriptions.size(); i++) {
+        if (0 == (_subscriptions[i].mask & bit)) continue;
+        if (_subscriptions[i].callback) {
+            _subscriptions[i].callback(event, _subscriptions[i].context);
+        } else if (_subscriptions[i].event_fn) {
+            _subscriptions[i].event_fn(event);
+        } else {
+            _subscriptions[i].message_fn(event.message, parameter);
+        }
+    }
+    _dispatching = false;
+
+    // Remove the subscriptions cancelled from a callback
+    if (_unsubscribed) {
+        _unsubscribed = false;
+        unsigned char count = 0;
+        for (unsigned char i=0; i < _subscriptions.size(); i++) {
+            if (0 == _subscriptions[i].id) continue;
+            if (count != i) _subscriptions[count] = _subscriptions[i];
+            count++;
+        }
+        _subscriptions.resize(count);
+    }
+
+}
+
+String JustWifi::_MAC2String(const unsigned char* mac) {
+    char buffer[20];
+    snprintf(
+        buffer, sizeof(buffer),
+        "%02x:%02x:%02x:%02x:%02x:%02x",
+        mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]
+    );
+    return String(buffer);
+}
+
+void JustWifi::_machine() {
+
+    #if false
+        static unsigned char previous = 0xFF;
+        if (_state != previous) {
+            previous = _state;
+            Serial.printf("_state: %u, WiFi.getMode(): %u\n", _state, _radio->getMode());
+        }
+    #endif
+
+    switch(_state) {
+
+        // ---------------------------------------------------------------------
+
+        case STATE_IDLE:
+
+            // Should we connect in STA mode?
+            if (_getStatus() != WL_CONNECTED) {
+
+                if (_sta_enabled) {
+                    if (_network_list.size() > 0) {
+                        if ((0 == _timeout) || ((_reconnect_timeout > 0) && (_radio->millis() - _timeout > _reconnect_delay))) {
+                            _rank_index = 0;
+                            bool scan = _scanNeeded();
+                            if (!scan) _rank();
+                            _state = scan ? STATE_SCAN_START : STATE_STA_START;
+                            if (_fast_enabled && _fastFind()) {
+                                _fast = true;
+                                _state = STATE_STA_START;
+                            }
+                            return;
+                        }
+                    }
+                }
+
+                // Fallback
+                if (!_ap_connected & _ap_fallback_enabled) {
+                    _state = STATE_FALLBACK;
+                }
+
+            // Look for a better access point of the same network?
+            } else if (_roaming_enabled && _roamCheck()) {
+                _state = STATE_ROAMING_START;
+            }
+
+            break;
+
+        // ---------------------------------------------------------------------
+
+        case STATE_SCAN_START:
+            _doScan();
+            _state = STATE_SCAN_ONGOING;
+            break;
+
+        case STATE_SCAN_ONGOING:
+            {
+                uint8_t response = _doScan();
+                if (RESPONSE_OK == response) {
+                    _state = STATE_STA_START;
+                } else if (RESPONSE_FAIL == response) {
+                    _state = STATE_FALLBACK;
+                }
+            }
+            break;
+
+        // ---------------------------------------------------------------------
+
+        case STATE_STA_START:
+            if (_rank_index >= _ranking.size()) {
+                _state = STATE_STA_FAILED;
+                break;
+            }
+            _doSTA(&_ranking[_rank_index]);
             _state = STATE_STA_ONGOING;
             break;
 
@@ -489,27 +1371,50 @@ void JustWifi::_machine() {
                 if (RESPONSE_OK == response) {
                     _state = STATE_STA_SUCCESS;
                 } else if (RESPONSE_FAIL == response) {
+
+                    // Fast path failed, forget it and go the long way
+                    if (_fast) {
+                        _fast = false;
+                        resetFastConnect();
+                        _rank_index = 0;
+                        bool scan = _scanNeeded();
+                        if (!scan) _rank();
+                        _state = scan ? STATE_SCAN_START : STATE_STA_START;
+                        break;
+                    }
+
+                    // Next access point or network in the ranking
                     _state = STATE_STA_START;
-                    if (_scan) {
-                        _currentID = _network_list[_currentID].next;
-                        if (_currentID == 0xFF) {
-                            _state = STATE_STA_FAILED;
-                        }
-                    } else {
-                        _currentID++;
-                        if (_currentID == _network_list.size()) {
-                            _state = STATE_STA_FAILED;
-                        }
+                    if (++_rank_index >= _ranking.size()) {
+                        _state = STATE_STA_FAILED;
                     }
                 }
             }
             break;
 
         case STATE_STA_FAILED:
+
+            // Nothing in the last scan worked, do not reuse it
+            invalidateScan();
+
+            // The targeted scan might have missed a better network
+            if (_scan && _scan_targeted && _scan_fallback) {
+                _scan_targeted = false;
+                _scan_sweep = true;
+                _rank_index = 0;
+                _state = STATE_SCAN_START;
+                break;
+            }
+
             _state = STATE_FALLBACK;
             break;
 
         case STATE_STA_SUCCESS:
+            _connected_id = _sta_rank.id;
+            _fast = false;
+            _backoff_failures = 0;
+            _reconnect_delay = _reconnect_timeout;
+            _roaming_rssi = 0;
             _state = STATE_IDLE;
             break;
 
@@ -523,12 +1428,12 @@ void JustWifi::_machine() {
 
             _disable();
 
-            if (!WiFi.enableSTA(true)) {
+            if (!_radio->enableSTA(true)) {
                 _state = STATE_WPS_FAILED;
                 return;
             }
 
-            WiFi.disconnect();
+            _radio->disconnect();
 
             if (!wifi_wps_disable()) {
                 _state = STATE_WPS_FAILED;
@@ -541,8 +1446,10 @@ void JustWifi::_machine() {
                 return;
             }
 
-            _jw_wps_status = (wps_cb_status) 5;
-            if (!wifi_set_wps_cb((wps_st_cb_t) &_jw_wps_status_cb)) {
+            // The SDK callback has no context argument
+            _wps_status = (wps_cb_status) 5;
+            _wps_instance = this;
+            if (!wifi_set_wps_cb((wps_st_cb_t) &_onWPS)) {
                 _state = STATE_WPS_FAILED;
                 return;
             }
@@ -556,9 +1463,9 @@ void JustWifi::_machine() {
             break;
 
         case STATE_WPS_ONGOING:
-            if (5 == _jw_wps_status) {
+            if (5 == _wps_status) {
                 // Still ongoing
-            } else if (WPS_CB_ST_SUCCESS == _jw_wps_status) {
+            } else if (WPS_CB_ST_SUCCESS == _wps_status) {
                 _state = STATE_WPS_SUCCESS;
             } else {
                 _state = STATE_WPS_FAILED;
@@ -568,12 +1475,14 @@ void JustWifi::_machine() {
         case STATE_WPS_FAILED:
             _doCallback(MESSAGE_WPS_ERROR);
             wifi_wps_disable();
+            _wps_instance = NULL;
             _state = STATE_FALLBACK;
             break;
 
         case STATE_WPS_SUCCESS:
             _doCallback(MESSAGE_WPS_SUCCESS);
             wifi_wps_disable();
+            _wps_instance = NULL;
             addCurrentNetwork(true);
             _state = STATE_IDLE;
             break;
@@ -590,28 +1499,28 @@ void JustWifi::_machine() {
 
             enableAP(false);
 
-            if (!WiFi.beginSmartConfig()) {
+            if (!_radio->beginSmartConfig()) {
                 _state = STATE_SMARTCONFIG_FAILED;
                 return;
             }
 
             _state = STATE_SMARTCONFIG_ONGOING;
-            _start = millis();
+            _start = _radio->millis();
 
             break;
 
         case STATE_SMARTCONFIG_ONGOING:
-            if (WiFi.smartConfigDone()) {
+            if (_radio->smartConfigDone()) {
                 _state = STATE_SMARTCONFIG_SUCCESS;
-            } else if (millis() - _start > JUSTWIFI_SMARTCONFIG_TIMEOUT) {
+            } else if (_radio->millis() - _start > JUSTWIFI_SMARTCONFIG_TIMEOUT) {
                 _state = STATE_SMARTCONFIG_FAILED;
             }
             break;
 
         case STATE_SMARTCONFIG_FAILED:
             _doCallback(MESSAGE_SMARTCONFIG_ERROR);
-            WiFi.stopSmartConfig();
-            WiFi.enableSTA(false);
+            _radio->stopSmartConfig();
+            _radio->enableSTA(false);
             _state = STATE_FALLBACK;
             break;
 
@@ -625,9 +1534,28 @@ void JustWifi::_machine() {
 
         // ---------------------------------------------------------------------
 
+        case STATE_ROAMING_START:
+            _state = (RESPONSE_WAIT == _doRoam()) ? STATE_ROAMING_ONGOING : STATE_IDLE;
+            break;
+
+        case STATE_ROAMING_ONGOING:
+            {
+                uint8_t response = _doRoam();
+                if (RESPONSE_OK == response) {
+                    _roamSwitch();
+                    _state = STATE_STA_START;
+                } else if (RESPONSE_FAIL == response) {
+                    _state = STATE_IDLE;
+                }
+            }
+            break;
+
+        // ---------------------------------------------------------------------
+
         case STATE_FALLBACK:
             if (!_ap_connected & _ap_fallback_enabled) _doAP();
-            _timeout = millis();
+            _timeout = _radio->millis();
+            _reconnect_delay = _backoffNext();
             _state = STATE_IDLE;
             break;
 
@@ -639,86 +1567,317 @@ void JustWifi::_machine() {
 
 }
 
+#ifdef JUSTWIFI_ENABLE_METRICS
+
+static const uint32_t _jw_metrics_bounds[JUSTWIFI_METRICS_BUCKETS - 1] = {
+    100, 250, 500, 1000, 2500, 5000, 10000
+};
+
+void JustWifi::_metricsRecord(justwifi_histogram_t & histogram, unsigned long ms) {
+    uint8_t bucket = 0;
+    while ((bucket < JUSTWIFI_METRICS_BUCKETS - 1) && (ms >= _jw_metrics_bounds[bucket])) bucket++;
+    if (histogram.buckets[bucket] < 0xFFFF) histogram.buckets[bucket]++;
+    histogram.count++;
+    histogram.total += ms;
+    if (ms > histogram.max) histogram.max = ms;
+}
+
+// Called after every state machine step, times the state we are leaving
+// and counts the one we are entering
+void JustWifi::_metricsUpdate() {
+
+    if (_state == _metrics_state) return;
+
+    justwifi_states_t previous = _metrics_state;
+    unsigned long now = _radio->millis();
+    _metrics_state = _state;
+    _metrics.transitions++;
+
+    if (STATE_IDLE == previous) _metrics_cycle = now;
+
+    if (STATE_SCAN_ONGOING == previous) {
+        _metricsRecord(_metrics.scan, now - _metrics.entered[STATE_SCAN_START]);
+    }
+
+    if (STATE_STA_ONGOING == previous) {
+        unsigned long elapsed = now - _metrics.entered[STATE_STA_ONGOING];
+        _metricsRecord(_metrics.attempt, elapsed);
+        if (STATE_STA_SUCCESS == _state) {
+            _metrics.connections++;
+            _metricsRecord(_metrics.ip, elapsed);
+            _metricsRecord(_metrics.connect, now - _metrics_cycle);
+        } else {
+            _metrics.failures++;
+        }
+    }
+
+    switch (_state) {
+        case STATE_SCAN_START:          _metrics.scans++; break;
+        case STATE_STA_ONGOING:         _metrics.attempts++; break;
+        case STATE_WPS_SUCCESS:         _metrics.wps_success++; break;
+        case STATE_WPS_FAILED:          _metrics.wps_failed++; break;
+        case STATE_SMARTCONFIG_SUCCESS: _metrics.smartconfig_success++; break;
+        case STATE_SMARTCONFIG_FAILED:  _metrics.smartconfig_failed++; break;
+        case STATE_FALLBACK:
+            if (!_ap_connected & _ap_fallback_enabled) _metrics.fallbacks++;
+            break;
+        case STATE_ROAMING_START:       _metrics.roaming_scans++; break;
+        default:
+            break;
+    }
+
+    _metrics.entered[_state] = now;
+
+}
+
+#endif // JUSTWIFI_ENABLE_METRICS
+
+// Wait before the next connection cycle after a failed one
+unsigned long JustWifi::_backoffNext() {
+
+    unsigned long min = _reconnect_timeout;
+    unsigned long max = (_backoff_max > min) ? _backoff_max : min;
+    if ((BACKOFF_NONE == _backoff) || (0 == min)) return min;
+
+    if (_backoff_failures < 0xFF) _backoff_failures++;
+
+    // Decorrelated: random between the minimum and three times the last wait
+    if (BACKOFF_DECORRELATED_JITTER == _backoff) {
+        unsigned long upper = (_reconnect_delay > max / 3) ? max : _reconnect_delay * 3;
+        if (upper < min) upper = min;
+        return min + _jw_random(_backoff_random) % (upper - min + 1);
+    }
+
+    // min * 2^(failures - 1), doubled once more as the jitter range
+    uint8_t doublings = _backoff_failures - 1;
+    if (BACKOFF_FULL_JITTER == _backoff) doublings++;
+    unsigned long ceiling = min;
+    while (doublings-- && (ceiling < max)) {
+        ceiling = (ceiling > max / 2) ? max : ceiling * 2;
+    }
+
+    if (BACKOFF_EXPONENTIAL == _backoff) return ceiling;
+    return min + _jw_random(_backoff_random) % (ceiling - min + 1);
+
+}
+
+unsigned long JustWifi::_next() {
+
+    // Pending work
+    if (_radio_events) return 0;
+    if (_queue_enabled && (_queue_stats.count > 0)) return 0;
+    if (_pmk_enabled && ((_pmk_id != 0xFFFF) || _pmk_pending)) {
+        if ((_state == STATE_IDLE) || (_state == STATE_SCAN_ONGOING) || (_state == STATE_STA_ONGOING)) return 0;
+    }
+
+    switch (_state) {
+
+        case STATE_IDLE:
+            if (_sta_enabled && (_network_list.size() > 0) && (_reconnect_timeout > 0) && (_timeout > 0)) {
+                unsigned long elapsed = _radio->millis() - _timeout;
+                if (elapsed >= _reconnect_delay) return 0;
+                unsigned long remaining = _reconnect_delay - elapsed;
+                if (remaining < JUSTWIFI_IDLE_POLL_INTERVAL) return remaining;
+            }
+            return JUSTWIFI_IDLE_POLL_INTERVAL;
+
+        case STATE_SCAN_ONGOING:
+        case STATE_STA_ONGOING:
+        case STATE_WPS_ONGOING:
+        case STATE_SMARTCONFIG_ONGOING:
+        case STATE_ROAMING_ONGOING:
+            return JUSTWIFI_POLL_INTERVAL;
+
+        default:
+            return 0;
+
+    }
+
+}
+
+// Anything pointing into the network list is stale after it changes
+void JustWifi::_resetNetworks() {
+    _candidates.clear();
+    _ranking.clear();
+    _scan_cached = false;
+    _pmk_id = 0xFFFF;
+    _pmk_pending = true;
+    _ssid_index_dirty = true;
+    _sta_rank.id = 0xFFFF;
+    _connected_id = 0xFFFF;
+    _roaming_id = 0xFFFF;
+    _roaming_target.id = 0xFFFF;
+
+    // An attempt in progress was made with the old list, start over
+    if ((STATE_STA_START == _state) || (STATE_STA_ONGOING == _state)) {
+        _radio->enableSTA(false);
+        _fast = false;
+        _timeout = 0;
+        _state = STATE_IDLE;
+    }
+
+}
+
+void JustWifi::_imageHeader(justwifi_image_t & header) {
+    header.magic = JUSTWIFI_IMAGE_MAGIC;
+    header.version = JUSTWIFI_IMAGE_VERSION;
+    header.record = sizeof(network_t);
+    header.count = _network_list.size();
+    header.reserved = 0;
+    header.crc = _jw_crc32(((uint8_t *) &header) + sizeof(header.crc), sizeof(header) - sizeof(header.crc));
+    header.crc = _jw_crc32(_network_list.data(), _network_list.size() * sizeof(network_t), header.crc);
+}
+
+bool JustWifi::_imageCheck(const justwifi_image_t & header, const network_t * records) {
+
+    if (header.magic != JUSTWIFI_IMAGE_MAGIC) return false;
+    if (header.version != JUSTWIFI_IMAGE_VERSION) return false;
+    if (header.record != sizeof(network_t)) return false;
+
+    uint32_t crc = _jw_crc32(((uint8_t *) &header) + sizeof(header.crc), sizeof(header) - sizeof(header.crc));
+    crc = _jw_crc32(records, header.count * sizeof(network_t), crc);
+    if (crc != header.crc) return false;
+
+    // Strings are used as is later on
+    for (uint16_t i = 0; i < header.count; i++) {
+        if (records[i].ssid[JUSTWIFI_SSID_SIZE] || records[i].pass[JUSTWIFI_PASS_SIZE]) return false;
+        #ifdef JUSTWIFI_ENABLE_ENTERPRISE
+        if (records[i].enterprise_username[JUSTWIFI_ENTERPRISE_SIZE]) return false;
+        if (records[i].enterprise_password[JUSTWIFI_ENTERPRISE_SIZE]) return false;
+        #endif
+    }
+
+    return true;
+
+}
+
 //------------------------------------------------------------------------------
 // CONFIGURATION METHODS
 //------------------------------------------------------------------------------
 
 void JustWifi::cleanNetworks() {
-    for (uint8_t i = 0; i < _network_list.size(); i++) {
-        network_t entry = _network_list[i];
-        if (entry.ssid) free(entry.ssid);
-        if (entry.pass) free(entry.pass);
-    }
     _network_list.clear();
+    _resetNetworks();
 }
 
-bool JustWifi::addNetwork(
-    const char * ssid,
-    const char * pass,
-    const char * ip,
-    const char * gw,
-    const char * netmask,
-    const char * dns,
-    bool front,
-    const char * enterprise_username,
-    const char * enterprise_password
-) {
+// Fills a network record from its configuration, false if it is not valid
+bool JustWifi::_makeNetwork(const justwifi_network_t & config, network_t & network) {
 
-    network_t new_network;
+    const char * ssid = config.ssid;
+    const char * pass = config.pass;
+    const char * ip = config.ip;
+    const char * gw = config.gw;
+    const char * netmask = config.netmask;
+    const char * dns = config.dns;
+
+    // Zeroed so exported images do not carry stale padding
+    memset(&network, 0, sizeof(network));
 
     // Check SSID too long or missing
-    if (!ssid || *ssid == 0x00 || strlen(ssid) > 31) {
+    if (!ssid || *ssid == 0x00 || strlen(ssid) > JUSTWIFI_SSID_SIZE) {
         return false;
     }
 
-    // Check PASS too long
+    // Check PASS too long, 64 chars are only valid as a hex PSK
+    bool psk = false;
     if (pass && strlen(pass) > 63) {
-        return false;
-    }
-
-    // Copy network SSID
-    new_network.ssid = strdup(ssid);
-    if (!new_network.ssid) {
-        return false;
-    }
-
-    // Copy network PASS
-    if (pass && *pass != 0x00) {
-        new_network.pass = strdup(pass);
-        if (!new_network.pass) {
-            free(new_network.ssid);
-            return false;
+        if (strlen(pass) > JUSTWIFI_PASS_SIZE) return false;
+        for (uint8_t i = 0; i < 64; i++) {
+            if (!isxdigit(pass[i])) return false;
         }
-    } else {
-        new_network.pass = NULL;
+        psk = true;
     }
 
+    // Copy network SSID and PASS
+    strcpy(network.ssid, ssid);
+    strcpy(network.pass, pass ? pass : "");
+
     // Copy static config
-    new_network.dhcp = true;
+    network.dhcp = true;
     if (ip && gw && netmask
         && *ip != 0x00 && *gw != 0x00 && *netmask != 0x00) {
-        new_network.dhcp = false;
-        new_network.ip.fromString(ip);
-        new_network.gw.fromString(gw);
-        new_network.netmask.fromString(netmask);
+        IPAddress address;
+        network.dhcp = false;
+        address.fromString(ip);
+        network.ip = address;
+        address.fromString(gw);
+        network.gw = address;
+        address.fromString(netmask);
+        network.netmask = address;
     }
     if (dns && *dns != 0x00) {
-        new_network.dns.fromString(dns);
+        IPAddress address;
+        address.fromString(dns);
+        network.dns = address;
     }
+    #ifdef JUSTWIFI_ENABLE_ENTERPRISE
+    const char * enterprise_username = config.enterprise_username;
+    const char * enterprise_password = config.enterprise_password;
     if (enterprise_username && enterprise_password && *enterprise_username != 0x00 && *enterprise_password != 0x00) {
-        new_network.enterprise_username = strdup(enterprise_username);
-        new_network.enterprise_password = strdup(enterprise_password);
+        if (strlen(enterprise_username) > JUSTWIFI_ENTERPRISE_SIZE) return false;
+        if (strlen(enterprise_password) > JUSTWIFI_ENTERPRISE_SIZE) return false;
+        strcpy(network.enterprise_username, enterprise_username);
+        strcpy(network.enterprise_password, enterprise_password);
+    }
+    #endif
+
+    // A PSK is the PMK itself, otherwise it will be derived in idle time
+    network.pmk_ready = psk;
+    network.hidden = config.hidden;
+    network.priority = config.priority;
+
+    // No history, even odds
+    network.stats.success = 128;
+    if (psk) {
+        for (uint8_t i = 0; i < JUSTWIFI_PMK_SIZE; i++) {
+            char hex[3] = { pass[2*i], pass[2*i+1], 0 };
+            network.pmk[i] = strtoul(hex, NULL, 16);
+        }
     }
 
-    // Defaults
-    new_network.rssi = 0;
-    new_network.security = 0;
-    new_network.channel = 0;
-    new_network.next = 0xFF;
-    new_network.scanned = false;
+    return true;
+
+}
+
+bool JustWifi::addNetwork(
+    const char * ssid,
+    const char * pass,
+    const char * ip,
+    const char * gw,
+    const char * netmask,
+    const char * dns,
+    bool front,
+    const char * enterprise_username,
+    const char * enterprise_password,
+    bool hidden
+) {
+
+    justwifi_network_t config = {
+        ssid, pass, ip, gw, netmask, dns,
+        enterprise_username, enterprise_password,
+        hidden, 0
+    };
+
+    network_t new_network;
+    if (!_makeNetwork(config, new_network)) return false;
+
+    // Indexes might change, restart any ongoing PMK derivation
+    _pmk_id = 0xFFFF;
+    _pmk_pending = true;
+    _ssid_index_dirty = true;
+
+    // The new network might be around, scan again
+    _scan_cached = false;
 
     // Store data
+    // Everything pointing into the list moves one place when adding in front
     if (front) {
+        for (uint16_t i = 0; i < _candidates.size(); i++) _candidates[i].id++;
+        for (uint16_t i = 0; i < _ranking.size(); i++) _ranking[i].id++;
+        if (_sta_rank.id < _network_list.size()) _sta_rank.id++;
+        if (_connected_id < _network_list.size()) _connected_id++;
+        if (_roaming_id < _network_list.size()) _roaming_id++;
+        if (_roaming_target.id < _network_list.size()) _roaming_target.id++;
         _network_list.insert(_network_list.begin(), new_network);
     } else {
         _network_list.push_back(new_network);
@@ -727,10 +1886,110 @@ bool JustWifi::addNetwork(
 
 }
 
+// Replaces the whole network list at once, every entry is checked before
+// the current list is touched. Networks that stay (same SSID and password)
+// keep their PMK and learned stats.
+bool JustWifi::setNetworks(const justwifi_network_t * networks, uint16_t count) {
+
+    if (!networks && count) return false;
+
+    std::vector<network_t> list;
+    list.reserve(count);
+
+    network_t network;
+    for (uint16_t i = 0; i < count; i++) {
+        if (!_makeNetwork(networks[i], network)) return false;
+        network_t * previous = _findSame(network);
+        if (previous) {
+            if (previous->pmk_ready) {
+                memcpy(network.pmk, previous->pmk, sizeof(network.pmk));
+                network.pmk_ready = true;
+            }
+            network.channel = previous->channel;
+            network.stats = previous->stats;
+        }
+        list.push_back(network);
+    }
+
+    _network_list.swap(list);
+    _resetNetworks();
+    return true;
+
+}
+
+// Image of the network list with credentials, static configuration,
+// PMKs and learned stats, returns its size or 0 if it does not fit
+// (the size needed if buffer is NULL)
+size_t JustWifi::exportNetworks(uint8_t * buffer, size_t size) {
+
+    size_t records = _network_list.size() * sizeof(network_t);
+    size_t total = sizeof(justwifi_image_t) + records;
+    if (!buffer) return total;
+    if (size < total) return 0;
+
+    justwifi_image_t header;
+    _imageHeader(header);
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), _network_list.data(), records);
+    return total;
+
+}
+
+// Same to a file or any other output, returns the bytes written
+size_t JustWifi::exportNetworks(Print & output) {
+    justwifi_image_t header;
+    _imageHeader(header);
+    size_t written = output.write((const uint8_t *) &header, sizeof(header));
+    written += output.write((const uint8_t *) _network_list.data(), _network_list.size() * sizeof(network_t));
+    return written;
+}
+
+// Replaces the network list with an exported image, the current one
+// is kept if the image is not valid
+bool JustWifi::importNetworks(const uint8_t * buffer, size_t size) {
+
+    if (!buffer || (size < sizeof(justwifi_image_t))) return false;
+
+    justwifi_image_t header;
+    memcpy(&header, buffer, sizeof(header));
+    if (size < sizeof(header) + (size_t) header.count * sizeof(network_t)) return false;
+
+    // The buffer might not be aligned for network_t
+    std::vector<network_t> list(header.count);
+    memcpy(list.data(), buffer + sizeof(header), header.count * sizeof(network_t));
+    if (!_imageCheck(header, list.data())) return false;
+
+    _network_list.swap(list);
+    _resetNetworks();
+    return true;
+
+}
+
+// The whole image has to be available already (like with a file),
+// so a corrupted count cannot trigger a huge allocation
+bool JustWifi::importNetworks(Stream & input) {
+
+    justwifi_image_t header;
+    if (input.readBytes((uint8_t *) &header, sizeof(header)) != sizeof(header)) return false;
+    if (header.magic != JUSTWIFI_IMAGE_MAGIC) return false;
+    if ((header.version != JUSTWIFI_IMAGE_VERSION) || (header.record != sizeof(network_t))) return false;
+
+    size_t records = header.count * sizeof(network_t);
+    if ((size_t) input.available() < records) return false;
+    std::vector<network_t> list(header.count);
+    if (input.readBytes((uint8_t *) list.data(), records) != records) return false;
+    if (!_imageCheck(header, list.data())) return false;
+
+    _network_list.swap(list);
+    _resetNetworks();
+    return true;
+
+}
+
 bool JustWifi::addCurrentNetwork(bool front) {
     return addNetwork(
-        WiFi.SSID().c_str(),
-        WiFi.psk().c_str(),
+        _radio->SSID().c_str(),
+        _radio->psk().c_str(),
         NULL, NULL, NULL, NULL,
         front
     );
@@ -745,7 +2004,7 @@ bool JustWifi::setSoftAP(
 ) {
 
     // Check SSID too long or missing
-    if (!ssid || *ssid == 0x00 || strlen(ssid) > 31) {
+    if (!ssid || *ssid == 0x00 || strlen(ssid) > JUSTWIFI_SSID_SIZE) {
         return false;
     }
 
@@ -755,39 +2014,34 @@ bool JustWifi::setSoftAP(
     }
 
     // Copy network SSID
-    if (_softap.ssid) free(_softap.ssid);
-    _softap.ssid = strdup(ssid);
-    if (!_softap.ssid) {
-        return false;
-    }
+    strcpy(_softap.ssid, ssid);
 
     // Copy network PASS
     if (pass && *pass != 0x00) {
-        if (_softap.pass) free(_softap.pass);
-        _softap.pass = strdup(pass);
-        if (!_softap.pass) {
-            _softap.ssid = NULL;
-            return false;
-        }
+        strcpy(_softap.pass, pass);
     }
 
     // Copy static config
     _softap.dhcp = false;
     if (ip && gw && netmask
         && *ip != 0x00 && *gw != 0x00 && *netmask != 0x00) {
+        IPAddress address;
         _softap.dhcp = true;
-        _softap.ip.fromString(ip);
-        _softap.gw.fromString(gw);
-        _softap.netmask.fromString(netmask);
+        address.fromString(ip);
+        _softap.ip = address;
+        address.fromString(gw);
+        _softap.gw = address;
+        address.fromString(netmask);
+        _softap.netmask = address;
     }
 
-    if ((WiFi.getMode() & WIFI_AP) > 0) {
+    if ((_radio->getMode() & WIFI_AP) > 0) {
 
     // https://github.com/xoseperez/justwifi/issues/4
-    if (_softap.pass) {
-        WiFi.softAP(_softap.ssid, _softap.pass);
+    if (_softap.pass[0]) {
+        _radio->softAP(_softap.ssid, _softap.pass);
     } else {
-        WiFi.softAP(_softap.ssid);
+        _radio->softAP(_softap.ssid);
         }
 
     }
@@ -800,28 +2054,145 @@ void JustWifi::setConnectTimeout(unsigned long ms) {
     _connect_timeout = ms;
 }
 
-void JustWifi::setReconnectTimeout(unsigned long ms) {
+// Wait for each network as long as it usually takes, within min and max (ms),
+// the connect timeout is used until a network has connected once
+void JustWifi::enableAdaptiveTimeout(bool enabled, unsigned long min, unsigned long max) {
+    _adaptive_timeout = enabled;
+    _timeout_min = min;
+    _timeout_max = max;
+}
+
+void JustWifi::setReconnectTimeout(unsigned long ms, justwifi_backoff_t backoff, unsigned long max) {
     _reconnect_timeout = ms;
+    _reconnect_delay = ms;
+    _backoff = backoff;
+    _backoff_max = max;
+    _backoff_failures = 0;
 }
 
+// Restarts the current wait, the backoff only resets after connecting
 void JustWifi::resetReconnectTimeout() {
-    _timeout = millis();
+    _timeout = _radio->millis();
 }
 
 void JustWifi::setHostname(const char * hostname) {
-    strncpy(_hostname, hostname, sizeof(_hostname));
+    strncpy(_hostname, hostname, sizeof(_hostname) - 1);
+    _hostname[sizeof(_hostname) - 1] = 0x00;
 }
 
-void JustWifi::subscribe(TMessageFunction fn) {
-    _callbacks.push_back(fn);
+uint16_t JustWifi::subscribe(TMessageFunction fn, uint32_t mask) {
+    subscription_t subscription;
+    subscription.mask = mask;
+    subscription.message_fn = fn;
+    subscription.callback = NULL;
+    return _subscribe(subscription);
+}
+
+uint16_t JustWifi::subscribeEvents(TEventFunction fn, uint32_t mask) {
+    subscription_t subscription;
+    subscription.mask = mask;
+    subscription.event_fn = fn;
+    subscription.callback = NULL;
+    return _subscribe(subscription);
+}
+
+// Plain function pointer, no std::function wrapper
+uint16_t JustWifi::subscribeCallback(justwifi_callback_t fn, void * context, uint32_t mask) {
+    subscription_t subscription;
+    subscription.mask = mask;
+    subscription.callback = fn;
+    subscription.context = context;
+    return _subscribe(subscription);
+}
+
+bool JustWifi::unsubscribe(uint16_t id) {
+
+    for (unsigned char i=0; i < _subscriptions.size(); i++) {
+        if ((0 == id) || (_subscriptions[i].id != id)) continue;
+
+        // Do not shift the list while it is being walked
+        if (_dispatching) {
+            _subscriptions[i].id = 0;
+            _subscriptions[i].mask = 0;
+            _unsubscribed = true;
+        } else {
+            _subscriptions.erase(_subscriptions.begin() + i);
+        }
+
+        _updateMasks();
+        return true;
+
+    }
+
+    return false;
+
 }
 
 //------------------------------------------------------------------------------
 // PUBLIC METHODS
 //------------------------------------------------------------------------------
 
+// Text for the messages that carry a parameter, returns 0 for the others
+size_t JustWifi::formatEvent(const justwifi_event_t & event, char * buffer, size_t size) {
+
+    if (MESSAGE_FOUND_NETWORK == event.message) {
+        return snprintf_P(buffer, size,
+            PSTR("%s BSSID: %02X:%02X:%02X:%02X:%02X:%02X CH: %2d RSSI: %3d SEC: %s SSID: %s"),
+            (event.known ? "-->" : "   "),
+            event.bssid[0], event.bssid[1], event.bssid[2], event.bssid[3], event.bssid[4], event.bssid[5],
+            event.channel,
+            event.rssi,
+            _encodingString(event.security),
+            event.ssid
+        );
+    }
+
+    if (MESSAGE_CONNECTING == event.message) {
+        if (event.fast) {
+            return snprintf_P(buffer, size,
+                PSTR("BSSID: %02X:%02X:%02X:%02X:%02X:%02X CH: %02d, SSID: %s (fast)"),
+                event.bssid[0], event.bssid[1], event.bssid[2], event.bssid[3], event.bssid[4], event.bssid[5],
+                event.channel,
+                event.ssid
+            );
+        }
+        if (event.bssid) {
+            return snprintf_P(buffer, size,
+                PSTR("BSSID: %02X:%02X:%02X:%02X:%02X:%02X CH: %02d, RSSI: %3d, SEC: %s, SSID: %s"),
+                event.bssid[0], event.bssid[1], event.bssid[2], event.bssid[3], event.bssid[4], event.bssid[5],
+                event.channel,
+                event.rssi,
+                _encodingString(event.security),
+                event.ssid
+            );
+        }
+        return snprintf_P(buffer, size, PSTR("SSID: %s"), event.ssid);
+    }
+
+    if (MESSAGE_CONNECT_FAILED == event.message) {
+        return snprintf_P(buffer, size, PSTR("%s"), event.ssid);
+    }
+
+    if (MESSAGE_ROAMING == event.message) {
+        return snprintf_P(buffer, size,
+            PSTR("BSSID: %02X:%02X:%02X:%02X:%02X:%02X CH: %02d, RSSI: %3d, SSID: %s"),
+            event.bssid[0], event.bssid[1], event.bssid[2], event.bssid[3], event.bssid[4], event.bssid[5],
+            event.channel,
+            event.rssi,
+            event.ssid
+        );
+    }
+
+    return 0;
+
+}
+
 wl_status_t JustWifi::getStatus() {
-    return WiFi.status();
+    return _radio->status();
+}
+
+justwifi_reason_t JustWifi::getFailReason() {
+    return _reason;
 }
 
 String JustWifi::getAPSSID() {
@@ -829,7 +2200,7 @@ String JustWifi::getAPSSID() {
 }
 
 bool JustWifi::connected() {
-    return (WiFi.status() == WL_CONNECTED);
+    return (_radio->status() == WL_CONNECTED);
 }
 
 bool JustWifi::connectable() {
@@ -838,28 +2209,29 @@ bool JustWifi::connectable() {
 
 void JustWifi::disconnect() {
     _timeout = 0;
-    WiFi.disconnect();
-    WiFi.enableSTA(false);
+    _status = WL_DISCONNECTED;
+    _radio->disconnect();
+    _radio->enableSTA(false);
     _doCallback(MESSAGE_DISCONNECTED);
 }
 
 void JustWifi::turnOff() {
-    WiFi.disconnect();
-    WiFi.enableAP(false);
-    WiFi.enableSTA(false);
-    WiFi.forceSleepBegin();
-    delay(1);
+    _radio->disconnect();
+    _radio->enableAP(false);
+    _radio->enableSTA(false);
+    _radio->forceSleepBegin();
+    _radio->delay(1);
     _doCallback(MESSAGE_TURNING_OFF);
     _sta_enabled = false;
     _state = STATE_IDLE;
 }
 
 void JustWifi::turnOn() {
-    WiFi.forceSleepWake();
-    delay(1);
-    setReconnectTimeout(0);
+    _radio->forceSleepWake();
+    _radio->delay(1);
+    setReconnectTimeout(0, _backoff, _backoff_max);
     _doCallback(MESSAGE_TURNING_ON);
-    WiFi.enableSTA(true);
+    _radio->enableSTA(true);
     _sta_enabled = true;
     _state = STATE_IDLE;
 }
@@ -884,8 +2256,8 @@ void JustWifi::enableAP(bool enabled) {
     if (enabled) {
         _doAP();
     } else {
-        WiFi.softAPdisconnect();
-        WiFi.enableAP(false);
+        _radio->softAPdisconnect();
+        _radio->enableAP(false);
         _ap_connected = false;
         _doCallback(MESSAGE_ACCESSPOINT_DESTROYED);
     }
@@ -895,13 +2267,207 @@ void JustWifi::enableAPFallback(bool enabled) {
     _ap_fallback_enabled = enabled;
 }
 
+void JustWifi::enableFastConnect(bool enabled) {
+    _fast_enabled = enabled;
+}
+
+void JustWifi::setFastConnectBuffer(justwifi_fast_t * buffer) {
+    _fast_buffer = buffer;
+}
+
+void JustWifi::resetFastConnect() {
+    memset(&_fast_data, 0, sizeof(_fast_data));
+    if (_fast_buffer) {
+        memset(_fast_buffer, 0, sizeof(_fast_data));
+    } else {
+        _radio->rtcWrite(JUSTWIFI_FAST_CONNECT_RTC_OFFSET, (uint32_t *) &_fast_data, sizeof(_fast_data));
+    }
+}
+
+void JustWifi::enablePMKCache(bool enabled) {
+    _pmk_enabled = enabled;
+}
+
+// Station connected, got IP and disconnected notifications from the radio
+// replace most of the status polling, returns false if not supported
+bool JustWifi::enableRadioEvents(bool enabled) {
+    if (_radio_events_enabled) _radio->onEvent(NULL, NULL);
+    _radio_events_enabled = enabled && _radio->onEvent(_onRadioEvent, this);
+    _radio_events = 0;
+    _status = _radio->status();
+    _status_polled = _radio->millis();
+    return _radio_events_enabled;
+}
+
+void JustWifi::enableEventQueue(bool enabled, unsigned long budget) {
+
+    // Flush pending events before going synchronous again
+    if (!enabled && _queue_enabled) dispatch();
+
+    _queue_enabled = enabled;
+    _queue_budget = budget;
+    if (enabled && _queue.empty()) {
+        _queue.resize(JUSTWIFI_EVENT_QUEUE_SIZE);
+        _queue_head = 0;
+        _queue_stats.size = JUSTWIFI_EVENT_QUEUE_SIZE;
+    }
+
+}
+
+// Delivers queued events until the queue is empty or the budget (in ms)
+// is over, at least one event is delivered per call, 0 means no limit
+uint16_t JustWifi::dispatch(unsigned long budget) {
+
+    unsigned long start = _radio->millis();
+    uint16_t count = 0;
+
+    while (_queue_stats.count > 0) {
+
+        // Free the slot first, callbacks might queue new events
+        queued_event_t queued = _queue[_queue_head];
+        _queue_head = (_queue_head + 1) % _queue.size();
+        _queue_stats.count--;
+
+        if (queued.event.ssid) queued.event.ssid = queued.ssid;
+        if (queued.event.bssid) queued.event.bssid = queued.bssid;
+        _deliver(queued.event);
+        count++;
+
+        if ((budget > 0) && (_radio->millis() - start >= budget)) break;
+
+    }
+
+    return count;
+
+}
+
+justwifi_queue_stats_t JustWifi::getEventQueueStats() {
+    return _queue_stats;
+}
+
+#ifdef JUSTWIFI_ENABLE_METRICS
+
+justwifi_metrics_t JustWifi::getMetrics() {
+    return _metrics;
+}
+
+void JustWifi::resetMetrics() {
+    memset(&_metrics, 0, sizeof(_metrics));
+    _metrics_state = _state;
+}
+
+#endif // JUSTWIFI_ENABLE_METRICS
+
+void JustWifi::enableQuarantine(bool enabled) {
+    _quarantine_enabled = enabled;
+    if (!enabled) memset(_quarantine, 0, sizeof(_quarantine));
+}
+
+// Weights of the signal, success ratio and time to connect in the ranking,
+// (1, 0, 0) orders by RSSI only like previous versions
+void JustWifi::setScoreWeights(uint8_t rssi, uint8_t success, uint8_t time) {
+    _score_rssi = rssi;
+    _score_success = success;
+    _score_time = time;
+}
+
+// Networks with a higher priority go first when their scores are equal
+bool JustWifi::setPriority(const char * ssid, uint8_t priority) {
+    bool found = false;
+    for (uint16_t i = 0; i < _network_list.size(); i++) {
+        if (strcmp(_network_list[i].ssid, ssid) == 0) {
+            _network_list[i].priority = priority;
+            found = true;
+        }
+    }
+    return found;
+}
+
+// Learned history of a network, to keep it across reboots
+bool JustWifi::getNetworkStats(const char * ssid, justwifi_stats_t & stats) {
+    for (uint16_t i = 0; i < _network_list.size(); i++) {
+        if (strcmp(_network_list[i].ssid, ssid) == 0) {
+            stats = _network_list[i].stats;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JustWifi::setNetworkStats(const char * ssid, const justwifi_stats_t & stats) {
+    bool found = false;
+    for (uint16_t i = 0; i < _network_list.size(); i++) {
+        if (strcmp(_network_list[i].ssid, ssid) == 0) {
+            _network_list[i].stats = stats;
+            found = true;
+        }
+    }
+    return found;
+}
+
 
 void JustWifi::enableScan(bool scan) {
     _scan = scan;
 }
 
-void JustWifi::loop() {
-    _machine();
+// How long scan results are reused, 0 to scan on every connection cycle
+void JustWifi::setScanTTL(unsigned long ms) {
+    _scan_ttl = ms;
+}
+
+void JustWifi::invalidateScan() {
+    _scan_cached = false;
+}
+
+// Scan only the channels known networks were last seen on,
+// sweeping all of them if none of those networks shows up
+void JustWifi::enableTargetedScan(bool enabled, bool fallback) {
+    _targeted_scan = enabled;
+    _scan_fallback = fallback;
+}
+
+// Stop a targeted scan as soon as a known network at or above rssi (dBm)
+// is found, 0 to always scan every channel
+void JustWifi::setScanThreshold(int8_t rssi) {
+    _scan_threshold = rssi;
+}
+
+// Reassociates to a stronger access point of the same network when the
+// average RSSI drops below threshold (dBm) and one is at least hysteresis
+// (dB) better, looking no more often than once per interval (ms)
+void JustWifi::enableRoaming(bool enabled, int8_t threshold, uint8_t hysteresis, unsigned long interval) {
+    _roaming_enabled = enabled;
+    _roaming_threshold = threshold;
+    _roaming_hysteresis = hysteresis;
+    _roaming_interval = interval;
+    _roaming_rssi = 0;
+}
+
+// Runs the state machine until it has to wait for the radio or a timer,
+// returns the time (in ms) the caller can wait before calling it again
+unsigned long JustWifi::loop() {
+
+    // Transitions requested from outside the state machine
+    #ifdef JUSTWIFI_ENABLE_METRICS
+        _metricsUpdate();
+    #endif
+
+    for (uint8_t i = 0; i < JUSTWIFI_MAX_STEPS; i++) {
+        justwifi_states_t previous = _state;
+        _machine();
+        #ifdef JUSTWIFI_ENABLE_METRICS
+            _metricsUpdate();
+        #endif
+        if (_state == previous) break;
+    }
+
+    _pmkLoop();
+    if (_queue_enabled) dispatch(_queue_budget);
+
+    return _next();
+
 }
 
+#if !defined(NO_GLOBAL_INSTANCES) && !defined(NO_GLOBAL_JUSTWIFI)
 JustWifi jw;
+#endif
@@ -26,7 +26,10 @@ along with the JustWifi library.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <functional>
 #include <vector>
+#include <algorithm>
 #include <ESP8266WiFi.h>
+#include "JustWifiRadio.h"
+#include "JustWifiPMK.h"
 
 #ifdef JUSTWIFI_ENABLE_ENTERPRISE
 #include "wpa2_enterprise.h"
@@ -46,6 +49,118 @@ extern "C" {
 #define DEFAULT_RECONNECT_INTERVAL      60000
 #define JUSTWIFI_SMARTCONFIG_TIMEOUT    60000
 
+// Adaptive connect timeout, each attempt waits the mean time to connect
+// of the network plus 4 times its deviation and the margin (ms),
+// within these bounds
+#ifndef JUSTWIFI_TIMEOUT_MIN
+#define JUSTWIFI_TIMEOUT_MIN            2000
+#endif
+#ifndef JUSTWIFI_TIMEOUT_MAX
+#define JUSTWIFI_TIMEOUT_MAX            30000
+#endif
+#define JUSTWIFI_TIMEOUT_MARGIN         500
+
+// Upper bound for the reconnect backoff
+#ifndef JUSTWIFI_BACKOFF_MAX
+#define JUSTWIFI_BACKOFF_MAX            900000
+#endif
+
+// How often loop() has to be called while waiting for the radio,
+// returned by loop() as a hint
+#ifndef JUSTWIFI_POLL_INTERVAL
+#define JUSTWIFI_POLL_INTERVAL          20
+#endif
+#ifndef JUSTWIFI_IDLE_POLL_INTERVAL
+#define JUSTWIFI_IDLE_POLL_INTERVAL     1000
+#endif
+
+// With radio events the status is still read every so often,
+// in case an event is missed
+#ifndef JUSTWIFI_EVENT_POLL_INTERVAL
+#define JUSTWIFI_EVENT_POLL_INTERVAL    1000
+#endif
+
+// Transitions done in a single loop() call at most
+#define JUSTWIFI_MAX_STEPS              16
+
+// Network credentials are stored inline, no heap allocation per network
+#define JUSTWIFI_SSID_SIZE              32
+#define JUSTWIFI_PASS_SIZE              64
+#ifndef JUSTWIFI_ENTERPRISE_SIZE
+#define JUSTWIFI_ENTERPRISE_SIZE        64
+#endif
+
+// Fast reconnect data is stored in RTC user memory by default,
+// offset is in 4-byte blocks (see ESP.rtcUserMemoryWrite)
+#ifndef JUSTWIFI_FAST_CONNECT_RTC_OFFSET
+#define JUSTWIFI_FAST_CONNECT_RTC_OFFSET    0
+#endif
+#define JUSTWIFI_FAST_CONNECT_VERSION       1
+
+// BSSIDs that fail are ranked last for a while, the penalty doubles
+// with every failure and the failure count halves every DECAY ms
+#ifndef JUSTWIFI_QUARANTINE_SIZE
+#define JUSTWIFI_QUARANTINE_SIZE            8
+#endif
+#define JUSTWIFI_QUARANTINE_PENALTY         120000
+#define JUSTWIFI_QUARANTINE_MAX_FAILURES    6
+#define JUSTWIFI_QUARANTINE_DECAY           1800000
+
+// Ranking score weights for the RSSI (blended with its history),
+// the success ratio and the mean time to connect of each network
+#ifndef JUSTWIFI_SCORE_RSSI
+#define JUSTWIFI_SCORE_RSSI                 2
+#endif
+#ifndef JUSTWIFI_SCORE_SUCCESS
+#define JUSTWIFI_SCORE_SUCCESS              1
+#endif
+#ifndef JUSTWIFI_SCORE_TIME
+#define JUSTWIFI_SCORE_TIME                 1
+#endif
+
+// Scan results are reused by connection cycles starting within this time (ms)
+#ifndef JUSTWIFI_SCAN_TTL
+#define JUSTWIFI_SCAN_TTL                   30000
+#endif
+
+// Roaming, while connected the RSSI is sampled every SAMPLE ms and when
+// its average falls below the threshold the channels the network was seen on
+// are scanned (at most once every INTERVAL ms), only access points
+// HYSTERESIS dB better than the current one are worth switching to
+#ifndef JUSTWIFI_ROAMING_THRESHOLD
+#define JUSTWIFI_ROAMING_THRESHOLD          -75
+#endif
+#ifndef JUSTWIFI_ROAMING_HYSTERESIS
+#define JUSTWIFI_ROAMING_HYSTERESIS         8
+#endif
+#ifndef JUSTWIFI_ROAMING_SAMPLE
+#define JUSTWIFI_ROAMING_SAMPLE             5000
+#endif
+#ifndef JUSTWIFI_ROAMING_INTERVAL
+#define JUSTWIFI_ROAMING_INTERVAL           60000
+#endif
+
+// Number of access points tried per known network on each scan
+#ifndef JUSTWIFI_MAX_BSSIDS
+#define JUSTWIFI_MAX_BSSIDS                 4
+#endif
+
+// PMK derivation work done on each loop while idle
+#ifndef JUSTWIFI_PMK_ITERATIONS_PER_LOOP
+#define JUSTWIFI_PMK_ITERATIONS_PER_LOOP    64
+#endif
+
+// Optional event queue, drained by loop() or dispatch()
+// for at most the given budget (in ms) per call
+#ifndef JUSTWIFI_EVENT_QUEUE_SIZE
+#define JUSTWIFI_EVENT_QUEUE_SIZE           16
+#endif
+#define JUSTWIFI_DISPATCH_BUDGET            5
+
+// Latency histograms (with JUSTWIFI_ENABLE_METRICS), bucket upper
+// bounds in ms are 100, 250, 500, 1000, 2500, 5000, 10000 and over
+#define JUSTWIFI_METRICS_BUCKETS            8
+
 #ifdef DEBUG_ESP_WIFI
 #ifdef DEBUG_ESP_PORT
 #define DEBUG_WIFI_MULTI(...) DEBUG_ESP_PORT.printf( __VA_ARGS__ )
@@ -56,24 +171,108 @@ extern "C" {
 #define DEBUG_WIFI_MULTI(...)
 #endif
 
+// Access point of a known network found in the last scan
 typedef struct {
-    char * ssid;
-    char * pass;
-    bool dhcp;
-    bool scanned;
-    IPAddress ip;
-    IPAddress gw;
-    IPAddress netmask;
-    IPAddress dns;
-    int32_t rssi;
-    uint8_t security;
-    uint8_t channel;
     uint8_t bssid[6];
-    uint8_t next;
-    char * enterprise_username;
-    char * enterprise_password;
+    uint8_t channel;
+    uint8_t security;
+    int8_t rssi;
+    bool quarantined;
+    uint16_t id;                    // network
+} justwifi_bssid_t;
+
+// Connection attempt order, networks by their best access point
+// and then each of their access points
+typedef struct {
+    int16_t network_score;
+    int16_t score;
+    uint16_t id;                    // network
+    uint16_t candidate;             // 0xFFFF when not scanned
+} justwifi_rank_t;
+
+// Learned from scans and connection attempts, in fixed point
+typedef struct {
+    int16_t rssi;                   // average in 1/16 dBm, 0 if never seen
+    uint8_t success;                // average outcome, 255 always connects
+    uint16_t time;                  // average time to connect in ms, 0 if never connected
+    uint16_t deviation;             // average deviation of the time to connect in ms
+} justwifi_stats_t;
+
+// Plain data with no pointers, so the list can be exported as is
+typedef struct {
+    char ssid[JUSTWIFI_SSID_SIZE + 1];
+    char pass[JUSTWIFI_PASS_SIZE + 1];      // empty for open networks
+    bool dhcp;
+    uint32_t ip;
+    uint32_t gw;
+    uint32_t netmask;
+    uint32_t dns;
+    #ifdef JUSTWIFI_ENABLE_ENTERPRISE
+    char enterprise_username[JUSTWIFI_ENTERPRISE_SIZE + 1];
+    char enterprise_password[JUSTWIFI_ENTERPRISE_SIZE + 1];
+    #endif
+    uint8_t pmk[JUSTWIFI_PMK_SIZE];
+    bool pmk_ready;
+    uint8_t channel;                        // last seen on, 0 if never
+    bool hidden;                            // found with directed probes
+    uint8_t priority;                       // higher first on equal scores
+    justwifi_stats_t stats;
 } network_t;
 
+// Network configuration for setNetworks, same fields as addNetwork
+typedef struct {
+    const char * ssid;
+    const char * pass;
+    const char * ip;
+    const char * gw;
+    const char * netmask;
+    const char * dns;
+    const char * enterprise_username;
+    const char * enterprise_password;
+    bool hidden;
+    uint8_t priority;
+} justwifi_network_t;
+
+// Binary image of the network list (see exportNetworks), this header
+// followed by the network_t records exactly as they are in memory,
+// so it can only be imported by a build with the same options
+#define JUSTWIFI_IMAGE_MAGIC            0x4C4E574A      // "JWNL"
+#define JUSTWIFI_IMAGE_VERSION          1
+
+typedef struct {
+    uint32_t crc;           // CRC32 of everything below and the records
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record;        // sizeof(network_t)
+    uint16_t count;
+    uint16_t reserved;
+} justwifi_image_t;
+
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t failures;
+    unsigned long last;
+} justwifi_quarantine_t;
+
+typedef struct {
+    uint32_t hash;
+    uint8_t length;
+    uint16_t id;                    // 0xFFFF for empty slots
+} justwifi_ssid_index_t;
+
+// Last good connection, CRC protected so it can live in RTC memory
+typedef struct {
+    uint32_t crc;           // CRC32 of everything below
+    uint32_t network;       // CRC32 of the network SSID and passphrase
+    uint32_t ip;
+    uint32_t gw;
+    uint32_t netmask;
+    uint32_t dns;
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t version;
+} justwifi_fast_t;
+
 typedef enum {
     STATE_IDLE,
     STATE_SCAN_START,
@@ -90,9 +289,13 @@ typedef enum {
     STATE_SMARTCONFIG_ONGOING,
     STATE_SMARTCONFIG_FAILED,
     STATE_SMARTCONFIG_SUCCESS,
-    STATE_FALLBACK
+    STATE_FALLBACK,
+    STATE_ROAMING_START,
+    STATE_ROAMING_ONGOING
 } justwifi_states_t;
 
+#define JUSTWIFI_STATES                 (STATE_ROAMING_ONGOING + 1)
+
 typedef enum {
     MESSAGE_SCANNING,
     MESSAGE_SCAN_FAILED,
@@ -116,9 +319,83 @@ typedef enum {
     MESSAGE_WPS_ERROR,
     MESSAGE_SMARTCONFIG_START,
     MESSAGE_SMARTCONFIG_SUCCESS,
-    MESSAGE_SMARTCONFIG_ERROR
+    MESSAGE_SMARTCONFIG_ERROR,
+    MESSAGE_ROAMING
 } justwifi_messages_t;
 
+// Wait between failed connection cycles, the reconnect timeout is the minimum
+typedef enum {
+    BACKOFF_NONE,                   // always the reconnect timeout
+    BACKOFF_EXPONENTIAL,            // doubles after every failed cycle
+    BACKOFF_FULL_JITTER,            // random between the minimum and the doubled wait
+    BACKOFF_DECORRELATED_JITTER     // random between the minimum and 3 times the last wait
+} justwifi_backoff_t;
+
+typedef enum {
+    REASON_NONE,
+    REASON_TIMEOUT,
+    REASON_NO_SSID,
+    REASON_CONNECT_FAILED
+} justwifi_reason_t;
+
+// Structured event, pointers are only valid during the callback
+typedef struct {
+    justwifi_messages_t message;
+    const char * ssid;
+    const uint8_t * bssid;
+    int8_t rssi;
+    uint8_t channel;
+    uint8_t security;               // ENC_TYPE_*
+    justwifi_reason_t reason;
+    bool known;                     // scan result of a known network
+    bool fast;                      // attempt using the fast reconnect data
+} justwifi_event_t;
+
+// Subscriptions only get the messages in their mask
+#define JUSTWIFI_MESSAGE_MASK(message)  (1UL << (message))
+#define JUSTWIFI_ALL_MESSAGES           0xFFFFFFFFUL
+
+typedef void (*justwifi_callback_t)(const justwifi_event_t & event, void * context);
+
+typedef struct {
+    uint16_t size;
+    uint16_t count;                 // events waiting
+    uint16_t peak;                  // highest count so far
+    uint32_t queued;
+    uint32_t dropped;               // the queue was full
+} justwifi_queue_stats_t;
+
+#ifdef JUSTWIFI_ENABLE_METRICS
+
+typedef struct {
+    uint16_t buckets[JUSTWIFI_METRICS_BUCKETS];     // saturate at 0xFFFF
+    uint32_t count;
+    uint32_t total;                 // ms, for the mean
+    uint32_t max;                   // ms
+} justwifi_histogram_t;
+
+typedef struct {
+    uint32_t transitions;
+    uint32_t entered[JUSTWIFI_STATES];  // millis() the state was last entered
+    uint32_t scans;
+    uint32_t attempts;
+    uint32_t connections;
+    uint32_t failures;              // attempts that did not connect
+    uint32_t fallbacks;             // to AP mode
+    uint32_t roaming_scans;
+    uint16_t wps_success;
+    uint16_t wps_failed;
+    uint16_t smartconfig_success;
+    uint16_t smartconfig_failed;
+    justwifi_histogram_t scan;      // scan duration
+    justwifi_histogram_t attempt;   // every attempt, whatever the outcome
+    justwifi_histogram_t link;      // attempt to association, needs radio events
+    justwifi_histogram_t ip;        // attempt to IP
+    justwifi_histogram_t connect;   // leaving idle to IP, scans and failed attempts included
+} justwifi_metrics_t;
+
+#endif // JUSTWIFI_ENABLE_METRICS
+
 enum {
     RESPONSE_START,
     RESPONSE_OK,
@@ -131,9 +408,27 @@ class JustWifi {
     public:
 
         JustWifi();
+        JustWifi(JustWifiRadio & radio);
         ~JustWifi();
 
         typedef std::function<void(justwifi_messages_t, char *)> TMessageFunction;
+        typedef std::function<void(const justwifi_event_t &)> TEventFunction;
+
+        typedef struct {
+            uint16_t id;
+            uint32_t mask;
+            TMessageFunction message_fn;
+            TEventFunction event_fn;
+            justwifi_callback_t callback;
+            void * context;
+        } subscription_t;
+
+        // Queued events own a copy of the SSID and BSSID
+        typedef struct {
+            justwifi_event_t event;
+            char ssid[JUSTWIFI_SSID_SIZE + 1];
+            uint8_t bssid[6];
+        } queued_event_t;
 
         void cleanNetworks();
         bool addCurrentNetwork(bool front = false);
@@ -146,8 +441,14 @@ class JustWifi {
             const char * dns = NULL,
             bool front = false,
             const char * enterprise_username = NULL,
-            const char * enterprise_password = NULL
+            const char * enterprise_password = NULL,
+            bool hidden = false
         );
+        bool setNetworks(const justwifi_network_t * networks, uint16_t count);
+        size_t exportNetworks(uint8_t * buffer, size_t size);
+        size_t exportNetworks(Print & output);
+        bool importNetworks(const uint8_t * buffer, size_t size);
+        bool importNetworks(Stream & input);
         bool setSoftAP(
             const char * ssid,
             const char * pass = NULL,
@@ -158,11 +459,26 @@ class JustWifi {
 
         void setHostname(const char * hostname);
         void setConnectTimeout(unsigned long ms);
-        void setReconnectTimeout(unsigned long ms = DEFAULT_RECONNECT_INTERVAL);
+        void enableAdaptiveTimeout(
+            bool enabled,
+            unsigned long min = JUSTWIFI_TIMEOUT_MIN,
+            unsigned long max = JUSTWIFI_TIMEOUT_MAX
+        );
+        void setReconnectTimeout(
+            unsigned long ms = DEFAULT_RECONNECT_INTERVAL,
+            justwifi_backoff_t backoff = BACKOFF_NONE,
+            unsigned long max = JUSTWIFI_BACKOFF_MAX
+        );
         void resetReconnectTimeout();
-        void subscribe(TMessageFunction fn);
+        uint16_t subscribe(TMessageFunction fn, uint32_t mask = JUSTWIFI_ALL_MESSAGES);
+        uint16_t subscribeEvents(TEventFunction fn, uint32_t mask = JUSTWIFI_ALL_MESSAGES);
+        uint16_t subscribeCallback(justwifi_callback_t fn, void * context = NULL, uint32_t mask = JUSTWIFI_ALL_MESSAGES);
+        bool unsubscribe(uint16_t id);
+
+        static size_t formatEvent(const justwifi_event_t & event, char * buffer, size_t size);
 
         wl_status_t getStatus();
+        justwifi_reason_t getFailReason();
         String getAPSSID();
 
         bool connected();
@@ -172,9 +488,37 @@ class JustWifi {
         void turnOn();
         void disconnect();
         void enableScan(bool scan);
+        void setScanTTL(unsigned long ms);
+        void invalidateScan();
+        void enableTargetedScan(bool enabled, bool fallback = true);
+        void setScanThreshold(int8_t rssi);
+        void enableRoaming(
+            bool enabled,
+            int8_t threshold = JUSTWIFI_ROAMING_THRESHOLD,
+            uint8_t hysteresis = JUSTWIFI_ROAMING_HYSTERESIS,
+            unsigned long interval = JUSTWIFI_ROAMING_INTERVAL
+        );
         void enableSTA(bool enabled);
         void enableAP(bool enabled);
         void enableAPFallback(bool enabled);
+        void enableFastConnect(bool enabled);
+        void setFastConnectBuffer(justwifi_fast_t * buffer);
+        void resetFastConnect();
+        void enablePMKCache(bool enabled);
+        void enableQuarantine(bool enabled);
+        void setScoreWeights(uint8_t rssi, uint8_t success, uint8_t time);
+        bool setPriority(const char * ssid, uint8_t priority);
+        bool getNetworkStats(const char * ssid, justwifi_stats_t & stats);
+        bool setNetworkStats(const char * ssid, const justwifi_stats_t & stats);
+        bool enableRadioEvents(bool enabled);
+        void enableEventQueue(bool enabled, unsigned long budget = JUSTWIFI_DISPATCH_BUDGET);
+        uint16_t dispatch(unsigned long budget = 0);
+        justwifi_queue_stats_t getEventQueueStats();
+
+        #ifdef JUSTWIFI_ENABLE_METRICS
+            justwifi_metrics_t getMetrics();
+            void resetMetrics();
+        #endif
 
         #if defined(JUSTWIFI_ENABLE_WPS)
             void startWPS();
@@ -184,41 +528,178 @@ class JustWifi {
             void startSmartConfig();
         #endif
 
-        void loop();
+        unsigned long loop();
 
     private:
 
+        JustWifiRadio * _radio;
+        bool _radio_events_enabled = false;
+        volatile uint8_t _radio_events = 0;
+        wl_status_t _status = WL_DISCONNECTED;
+        unsigned long _status_polled = 0;
         std::vector<network_t> _network_list;
-        std::vector<TMessageFunction> _callbacks;
+        std::vector<subscription_t> _subscriptions;
+        uint16_t _subscription_id = 0;
+        uint32_t _mask = 0;             // messages someone is subscribed to
+        uint32_t _text_mask = 0;        // messages a subscribe() callback wants as text
+        bool _dispatching = false;
+        bool _unsubscribed = false;
+
+        bool _queue_enabled = false;
+        unsigned long _queue_budget = JUSTWIFI_DISPATCH_BUDGET;
+        std::vector<queued_event_t> _queue;
+        uint16_t _queue_head = 0;
+        justwifi_queue_stats_t _queue_stats;
+        std::vector<justwifi_ssid_index_t> _ssid_index;
+        bool _ssid_index_dirty = true;
+        std::vector<justwifi_bssid_t> _candidates;
+        std::vector<justwifi_rank_t> _ranking;
+        uint16_t _rank_index = 0;
 
         unsigned long _connect_timeout = DEFAULT_CONNECT_TIMEOUT;
+        bool _adaptive_timeout = false;
+        unsigned long _timeout_min = JUSTWIFI_TIMEOUT_MIN;
+        unsigned long _timeout_max = JUSTWIFI_TIMEOUT_MAX;
         unsigned long _reconnect_timeout = DEFAULT_RECONNECT_INTERVAL;
+        unsigned long _reconnect_delay = DEFAULT_RECONNECT_INTERVAL;    // current wait
+        justwifi_backoff_t _backoff = BACKOFF_NONE;
+        unsigned long _backoff_max = JUSTWIFI_BACKOFF_MAX;
+        uint8_t _backoff_failures = 0;
+        uint32_t _backoff_random = 1;
         unsigned long _timeout = 0;
         unsigned long _start = 0;
-        uint8_t _currentID;
+
+        // Current connection attempt
+        justwifi_rank_t _sta_rank;
+        uint16_t _connected_id = 0xFFFF;    // network of the last successful attempt
+        uint8_t _sta_state = RESPONSE_START;
+        unsigned long _sta_timeout = 0;
+        unsigned long _sta_deadline = DEFAULT_CONNECT_TIMEOUT;
+        justwifi_reason_t _reason = REASON_NONE;
         bool _scan = false;
+        bool _scanning = false;
+        bool _scan_cached = false;
+        unsigned long _scan_time = 0;
+        unsigned long _scan_ttl = JUSTWIFI_SCAN_TTL;
+        bool _targeted_scan = false;
+        bool _scan_fallback = true;
+        bool _scan_targeted = false;    // the last scan only covered known channels
+        bool _scan_sweep = false;       // next scan covers all channels
+        uint16_t _scan_channels = 0;    // still to scan
+        uint16_t _scan_results = 0;
+        uint16_t _scan_hidden = 0;      // channels with access points hiding their SSID
+        bool _probing = false;
+        uint16_t _probe_id = 0;         // hidden network being probed
+        uint16_t _probe_channels = 0;   // still to probe for it
+        int8_t _scan_threshold = 0;
         char _hostname[32];
-        network_t _softap { NULL, NULL };
+        network_t _softap;
 
         justwifi_states_t _state = STATE_IDLE;
         bool _sta_enabled = true;
         bool _ap_connected = false;
         bool _ap_fallback_enabled = true;
 
+        bool _fast_enabled = false;
+        bool _fast = false;
+        bool _fast_static = false;
+        justwifi_fast_t * _fast_buffer = NULL;
+        justwifi_fast_t _fast_data;
+
+        bool _roaming_enabled = false;
+        int8_t _roaming_threshold = JUSTWIFI_ROAMING_THRESHOLD;
+        uint8_t _roaming_hysteresis = JUSTWIFI_ROAMING_HYSTERESIS;
+        unsigned long _roaming_interval = JUSTWIFI_ROAMING_INTERVAL;
+        bool _roaming = false;          // background scan running
+        int16_t _roaming_rssi = 0;      // average, 0 until the first sample
+        unsigned long _roaming_sampled = 0;
+        unsigned long _roaming_scanned = 0;
+        uint16_t _roaming_id = 0;       // current network
+        uint16_t _roaming_channels = 0;
+        justwifi_bssid_t _roaming_target;
+
+        bool _quarantine_enabled = true;
+        justwifi_quarantine_t _quarantine[JUSTWIFI_QUARANTINE_SIZE];
+
+        uint8_t _score_rssi = JUSTWIFI_SCORE_RSSI;
+        uint8_t _score_success = JUSTWIFI_SCORE_SUCCESS;
+        uint8_t _score_time = JUSTWIFI_SCORE_TIME;
+
+        #if defined(JUSTWIFI_ENABLE_WPS)
+            volatile wps_cb_status _wps_status;
+            static JustWifi * _wps_instance;
+            static void _onWPS(wps_cb_status status);
+        #endif
+
+        bool _pmk_enabled = true;
+        bool _pmk_pending = false;
+        uint16_t _pmk_id = 0xFFFF;
+        JustWifiPMK _pmk_job;
+
+        #ifdef JUSTWIFI_ENABLE_METRICS
+            justwifi_metrics_t _metrics;
+            justwifi_states_t _metrics_state = STATE_IDLE;
+            unsigned long _metrics_cycle = 0;
+        #endif
+
         bool _doAP();
         uint8_t _doScan();
-        uint8_t _doSTA(uint8_t id = 0xFF);
+        uint8_t _doSTA(justwifi_rank_t * rank = NULL);
+        uint8_t _doRoam();
 
+        void _init();
         void _disable();
         void _machine();
+        wl_status_t _getStatus();
+        static void _onRadioEvent(justwifi_radio_event_t event, void * context);
+        unsigned long _next();
+        bool _scanNeeded();
+        unsigned long _backoffNext();
+        bool _fastLoad();
+        void _fastSave(network_t * entry);
+        bool _fastFind();
+        void _pmkLoop();
+        #ifdef JUSTWIFI_ENABLE_METRICS
+            void _metricsUpdate();
+            static void _metricsRecord(justwifi_histogram_t & histogram, unsigned long ms);
+        #endif
+        justwifi_quarantine_t * _quarantineFind(const uint8_t * bssid);
+        bool _quarantined(const uint8_t * bssid);
+        void _quarantineFail(const uint8_t * bssid);
+        void _quarantineClear(const uint8_t * bssid);
+        uint16_t _scanChannels();
+        void _scanNext();
+        bool _scanProbe();
+        bool _roamCheck();
+        void _roamNext();
+        void _roamSwitch();
         uint8_t _populate(uint8_t networkCount);
-        uint8_t _sortByRSSI();
+        void _buildIndex();
+        bool _makeNetwork(const justwifi_network_t & config, network_t & network);
+        void _resetNetworks();
+        void _imageHeader(justwifi_image_t & header);
+        bool _imageCheck(const justwifi_image_t & header, const network_t * records);
+        int16_t _score(const network_t * entry, int8_t rssi, bool quarantined);
+        void _learn(network_t * entry, bool success, unsigned long time);
+        unsigned long _deadline(const network_t * entry);
+        network_t * _findNetwork(const uint8_t * ssid, uint8_t length, uint8_t security);
+        network_t * _findSame(const network_t & network);
+        void _rank();
         String _MAC2String(const unsigned char* mac);
-        String _encodingString(uint8_t security);
-        void _doCallback(justwifi_messages_t message, char * parameter = NULL);
+        static const char * _encodingString(uint8_t security);
+        bool _listening(justwifi_messages_t message);
+        uint16_t _subscribe(subscription_t & subscription);
+        void _updateMasks();
+        void _doCallback(justwifi_messages_t message);
+        void _doEvent(const justwifi_event_t & event);
+        void _enqueue(const justwifi_event_t & event);
+        void _deliver(const justwifi_event_t & event);
 
 };
 
+// Define NO_GLOBAL_JUSTWIFI to only use your own instances
+#if !defined(NO_GLOBAL_INSTANCES) && !defined(NO_GLOBAL_JUSTWIFI)
 extern JustWifi jw;
+#endif
 
 #endif
@@ -0,0 +1,221 @@
+/*
+
+JustWifi 2.0.0
+
+Wifi Manager for ESP8266
+
+Copyright (C) 2016-2018 by Xose Pérez <xose dot perez at gmail dot com>
+
+The JustWifi library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The JustWifi library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the JustWifi library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "JustWifiPMK.h"
+
+// -----------------------------------------------------------------------------
+// SHA1
+// -----------------------------------------------------------------------------
+
+#define _JW_ROL(x, n)   (((x) << (n)) | ((x) >> (32 - (n))))
+
+// Length in bits of a 64 byte key block followed by a 20 byte digest
+#define _JW_HMAC_BITS   ((64 + 20) * 8)
+
+static const uint32_t _jw_sha1_iv[5] = {
+    0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0
+};
+
+static void _jw_sha1_compress(uint32_t * state, const uint32_t * block) {
+
+    uint32_t w[16];
+    memcpy(w, block, sizeof(w));
+
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t e = state[4];
+
+    for (uint8_t i = 0; i < 80; i++) {
+
+        if (i >= 16) {
+            uint32_t x = w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15];
+            w[i & 15] = _JW_ROL(x, 1);
+        }
+
+        uint32_t f;
+        if (i < 20) {
+            f = ((b & c) | (~b & d)) + 0x5A827999;
+        } else if (i < 40) {
+            f = (b ^ c ^ d) + 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = ((b & c) | (b & d) | (c & d)) + 0x8F1BBCDC;
+        } else {
+            f = (b ^ c ^ d) + 0xCA62C1D6;
+        }
+
+        uint32_t t = _JW_ROL(a, 5) + f + e + w[i & 15];
+        e = d;
+        d = c;
+        c = _JW_ROL(b, 30);
+        b = a;
+        a = t;
+
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+
+}
+
+// Loads a 64 byte buffer as 16 big endian words
+static void _jw_sha1_load(const uint8_t * bytes, uint32_t * block) {
+    for (uint8_t i = 0; i < 16; i++) {
+        block[i] = ((uint32_t) bytes[4*i] << 24) | ((uint32_t) bytes[4*i+1] << 16)
+            | ((uint32_t) bytes[4*i+2] << 8) | bytes[4*i+3];
+    }
+}
+
+//------------------------------------------------------------------------------
+// PRIVATE METHODS
+//------------------------------------------------------------------------------
+
+// HMAC over a single, already padded, inner block
+void JustWifiPMK::_hmac(const uint32_t * block, uint32_t * digest) {
+
+    uint32_t state[5];
+    uint32_t outer[16] = {0};
+
+    memcpy(state, _inner, sizeof(state));
+    _jw_sha1_compress(state, block);
+
+    memcpy(outer, state, sizeof(state));
+    outer[5] = 0x80000000;
+    outer[15] = _JW_HMAC_BITS;
+
+    memcpy(digest, _outer, sizeof(_outer));
+    _jw_sha1_compress(digest, outer);
+
+}
+
+//------------------------------------------------------------------------------
+// PUBLIC METHODS
+//------------------------------------------------------------------------------
+
+void JustWifiPMK::begin(const char * pass, const uint8_t * salt, uint8_t salt_len, uint16_t iterations, uint8_t length) {
+
+    // Precompute HMAC key states, passphrases are at most 63 bytes
+    // so the key always fits in a single block
+    uint8_t pad[64];
+    uint32_t block[16];
+    uint8_t pass_len = strlen(pass);
+
+    memset(pad, 0x36, sizeof(pad));
+    for (uint8_t i = 0; i < pass_len; i++) pad[i] ^= pass[i];
+    _jw_sha1_load(pad, block);
+    memcpy(_inner, _jw_sha1_iv, sizeof(_inner));
+    _jw_sha1_compress(_inner, block);
+
+    memset(pad, 0x5C, sizeof(pad));
+    for (uint8_t i = 0; i < pass_len; i++) pad[i] ^= pass[i];
+    _jw_sha1_load(pad, block);
+    memcpy(_outer, _jw_sha1_iv, sizeof(_outer));
+    _jw_sha1_compress(_outer, block);
+
+    if (salt_len > sizeof(_salt)) salt_len = sizeof(_salt);
+    if (length > sizeof(_key)) length = sizeof(_key);
+    memcpy(_salt, salt, salt_len);
+    _salt_len = salt_len;
+    _iterations = iterations;
+    _length = length;
+    _iteration = 0;
+    _block = 1;
+    _done = false;
+
+}
+
+bool JustWifiPMK::step(uint16_t iterations) {
+
+    uint32_t block[16];
+
+    while (!_done && iterations--) {
+
+        // U1 = HMAC(pass, salt || INT(block))
+        if (0 == _iteration) {
+
+            uint8_t bytes[64] = {0};
+            memcpy(bytes, _salt, _salt_len);
+            bytes[_salt_len + 3] = _block;
+            bytes[_salt_len + 4] = 0x80;
+            uint16_t bits = (64 + _salt_len + 4) * 8;
+            bytes[62] = bits >> 8;
+            bytes[63] = bits & 0xFF;
+            _jw_sha1_load(bytes, block);
+
+            _hmac(block, _u);
+            memcpy(_t, _u, sizeof(_t));
+
+        // Un = HMAC(pass, Un-1)
+        } else {
+
+            memset(block, 0, sizeof(block));
+            memcpy(block, _u, sizeof(_u));
+            block[5] = 0x80000000;
+            block[15] = _JW_HMAC_BITS;
+
+            _hmac(block, _u);
+            for (uint8_t i = 0; i < 5; i++) _t[i] ^= _u[i];
+
+        }
+
+        // Block finished
+        if (++_iteration == _iterations) {
+            uint8_t * key = &_key[(_block - 1) * 20];
+            for (uint8_t i = 0; i < 5; i++) {
+                key[4*i] = _t[i] >> 24;
+                key[4*i+1] = _t[i] >> 16;
+                key[4*i+2] = _t[i] >> 8;
+                key[4*i+3] = _t[i];
+            }
+            if (_block * 20 >= _length) {
+                _done = true;
+            } else {
+                _block++;
+                _iteration = 0;
+            }
+        }
+
+    }
+
+    return _done;
+
+}
+
+bool JustWifiPMK::done() {
+    return _done;
+}
+
+void JustWifiPMK::get(uint8_t * key) {
+    memcpy(key, _key, _length);
+}
+
+void JustWifiPMK::compute(const char * ssid, const char * pass, uint8_t * pmk) {
+    JustWifiPMK job;
+    job.begin(pass, (const uint8_t *) ssid, strlen(ssid));
+    while (!job.step(JUSTWIFI_PMK_ITERATIONS)) {}
+    job.get(pmk);
+}
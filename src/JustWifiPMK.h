@@ -0,0 +1,76 @@
+/*
+
+JustWifi 2.0.0
+
+Wifi Manager for ESP8266
+
+Copyright (C) 2016-2018 by Xose Pérez <xose dot perez at gmail dot com>
+
+The JustWifi library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The JustWifi library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the JustWifi library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef JustWifiPMK_h
+#define JustWifiPMK_h
+
+#include <Arduino.h>
+
+#define JUSTWIFI_PMK_SIZE               32
+#define JUSTWIFI_PMK_ITERATIONS         4096
+
+// -----------------------------------------------------------------------------
+// WPA2-PSK pairwise master key derivation
+// PMK = PBKDF2-HMAC-SHA1(passphrase, ssid, 4096, 32)
+// The HMAC inner and outer key states are hashed once and reused for every
+// iteration, so each iteration costs exactly two SHA1 block compressions.
+// The work can be split across several calls to step() to avoid blocking.
+// -----------------------------------------------------------------------------
+
+class JustWifiPMK {
+
+    public:
+
+        void begin(
+            const char * pass,
+            const uint8_t * salt,
+            uint8_t salt_len,
+            uint16_t iterations = JUSTWIFI_PMK_ITERATIONS,
+            uint8_t length = JUSTWIFI_PMK_SIZE
+        );
+        bool step(uint16_t iterations);
+        bool done();
+        void get(uint8_t * key);
+
+        static void compute(const char * ssid, const char * pass, uint8_t * pmk);
+
+    private:
+
+        uint32_t _inner[5];
+        uint32_t _outer[5];
+        uint32_t _u[5];
+        uint32_t _t[5];
+        uint8_t _salt[51];      // salt, block index and padding must fit in one block
+        uint8_t _salt_len;
+        uint16_t _iterations;
+        uint16_t _iteration;
+        uint8_t _length;
+        uint8_t _block;
+        bool _done;
+        uint8_t _key[40];
+
+        void _hmac(const uint32_t * block, uint32_t * digest);
+
+};
+
+#endif
@@ -0,0 +1,274 @@
+/*
+
+JustWifi 2.0.0
+
+Wifi Manager for ESP8266
+
+Copyright (C) 2016-2018 by Xose Pérez <xose dot perez at gmail dot com>
+
+The JustWifi library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The JustWifi library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the JustWifi library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "JustWifiRadio.h"
+
+//------------------------------------------------------------------------------
+// SYSTEM
+//------------------------------------------------------------------------------
+
+unsigned long JustWifiESP8266Radio::millis() {
+    return ::millis();
+}
+
+void JustWifiESP8266Radio::delay(unsigned long ms) {
+    ::delay(ms);
+}
+
+uint32_t JustWifiESP8266Radio::chipId() {
+    return ESP.getChipId();
+}
+
+const char * JustWifiESP8266Radio::sdkVersion() {
+    return ESP.getSdkVersion();
+}
+
+bool JustWifiESP8266Radio::rtcRead(uint32_t offset, uint32_t * data, size_t size) {
+    return ESP.rtcUserMemoryRead(offset, data, size);
+}
+
+bool JustWifiESP8266Radio::rtcWrite(uint32_t offset, uint32_t * data, size_t size) {
+    return ESP.rtcUserMemoryWrite(offset, data, size);
+}
+
+//------------------------------------------------------------------------------
+// MODE
+//------------------------------------------------------------------------------
+
+WiFiMode_t JustWifiESP8266Radio::getMode() {
+    return WiFi.getMode();
+}
+
+bool JustWifiESP8266Radio::mode(WiFiMode_t mode) {
+    return WiFi.mode(mode);
+}
+
+bool JustWifiESP8266Radio::enableSTA(bool enabled) {
+    return WiFi.enableSTA(enabled);
+}
+
+bool JustWifiESP8266Radio::enableAP(bool enabled) {
+    return WiFi.enableAP(enabled);
+}
+
+void JustWifiESP8266Radio::persistent(bool persistent) {
+    WiFi.persistent(persistent);
+}
+
+bool JustWifiESP8266Radio::forceSleepBegin() {
+    return WiFi.forceSleepBegin();
+}
+
+bool JustWifiESP8266Radio::forceSleepWake() {
+    return WiFi.forceSleepWake();
+}
+
+//------------------------------------------------------------------------------
+// STATION
+//------------------------------------------------------------------------------
+
+bool JustWifiESP8266Radio::hostname(const char * hostname) {
+    return WiFi.hostname(hostname);
+}
+
+bool JustWifiESP8266Radio::config(IPAddress ip, IPAddress gw, IPAddress netmask, IPAddress dns) {
+    return WiFi.config(ip, gw, netmask, dns);
+}
+
+wl_status_t JustWifiESP8266Radio::begin(const char * ssid, const char * pass, int32_t channel, const uint8_t * bssid) {
+    return WiFi.begin(ssid, pass, channel, bssid);
+}
+
+bool JustWifiESP8266Radio::disconnect() {
+    return WiFi.disconnect();
+}
+
+wl_status_t JustWifiESP8266Radio::status() {
+    return WiFi.status();
+}
+
+bool JustWifiESP8266Radio::setAutoConnect(bool autoConnect) {
+    return WiFi.setAutoConnect(autoConnect);
+}
+
+bool JustWifiESP8266Radio::setAutoReconnect(bool autoReconnect) {
+    return WiFi.setAutoReconnect(autoReconnect);
+}
+
+String JustWifiESP8266Radio::SSID() {
+    return WiFi.SSID();
+}
+
+String JustWifiESP8266Radio::psk() {
+    return WiFi.psk();
+}
+
+uint8_t * JustWifiESP8266Radio::BSSID() {
+    return WiFi.BSSID();
+}
+
+int32_t JustWifiESP8266Radio::channel() {
+    return WiFi.channel();
+}
+
+int32_t JustWifiESP8266Radio::RSSI() {
+    return WiFi.RSSI();
+}
+
+IPAddress JustWifiESP8266Radio::localIP() {
+    return WiFi.localIP();
+}
+
+IPAddress JustWifiESP8266Radio::gatewayIP() {
+    return WiFi.gatewayIP();
+}
+
+IPAddress JustWifiESP8266Radio::subnetMask() {
+    return WiFi.subnetMask();
+}
+
+IPAddress JustWifiESP8266Radio::dnsIP() {
+    return WiFi.dnsIP();
+}
+
+//------------------------------------------------------------------------------
+// SCAN
+//------------------------------------------------------------------------------
+
+int8_t JustWifiESP8266Radio::scanNetworks(bool async, bool show_hidden, uint8_t channel, const char * ssid) {
+    return WiFi.scanNetworks(async, show_hidden, channel, (uint8 *) ssid);
+}
+
+int8_t JustWifiESP8266Radio::scanComplete() {
+    return WiFi.scanComplete();
+}
+
+void JustWifiESP8266Radio::scanDelete() {
+    WiFi.scanDelete();
+}
+
+// The scan class keeps the SDK results as a protected bss_info array,
+// reading them directly avoids a String per result in getNetworkInfo
+class JustWifiScanAccess : public ESP8266WiFiScanClass {
+    public:
+        static struct bss_info * info(uint8_t i) {
+            return reinterpret_cast<struct bss_info *>(_getScanInfoByIndex(i));
+        }
+};
+
+bool JustWifiESP8266Radio::getScanResult(uint8_t i, justwifi_scan_result_t &result) {
+
+    struct bss_info * info = JustWifiScanAccess::info(i);
+    if (!info) return false;
+
+    result.ssid = info->ssid;
+    result.ssid_len = (info->ssid_len > 32) ? 32 : info->ssid_len;
+    result.bssid = info->bssid;
+    result.rssi = info->rssi;
+    result.channel = info->channel;
+    result.hidden = (info->is_hidden > 0);
+
+    switch (info->authmode) {
+        case AUTH_OPEN:         result.security = ENC_TYPE_NONE; break;
+        case AUTH_WEP:          result.security = ENC_TYPE_WEP; break;
+        case AUTH_WPA_PSK:      result.security = ENC_TYPE_TKIP; break;
+        case AUTH_WPA2_PSK:     result.security = ENC_TYPE_CCMP; break;
+        default:                result.security = ENC_TYPE_AUTO; break;
+    }
+
+    return true;
+
+}
+
+//------------------------------------------------------------------------------
+// SOFT AP
+//------------------------------------------------------------------------------
+
+bool JustWifiESP8266Radio::softAP(const char * ssid, const char * pass) {
+    return WiFi.softAP(ssid, pass);
+}
+
+bool JustWifiESP8266Radio::softAPConfig(IPAddress ip, IPAddress gw, IPAddress netmask) {
+    return WiFi.softAPConfig(ip, gw, netmask);
+}
+
+bool JustWifiESP8266Radio::softAPdisconnect() {
+    return WiFi.softAPdisconnect();
+}
+
+//------------------------------------------------------------------------------
+// SMARTCONFIG
+//------------------------------------------------------------------------------
+
+bool JustWifiESP8266Radio::beginSmartConfig() {
+    return WiFi.beginSmartConfig();
+}
+
+bool JustWifiESP8266Radio::smartConfigDone() {
+    return WiFi.smartConfigDone();
+}
+
+bool JustWifiESP8266Radio::stopSmartConfig() {
+    return WiFi.stopSmartConfig();
+}
+
+//------------------------------------------------------------------------------
+// EVENTS
+//------------------------------------------------------------------------------
+
+void JustWifiESP8266Radio::_notify(justwifi_radio_event_t event) {
+    if (_callback) _callback(event, _context);
+}
+
+bool JustWifiESP8266Radio::onEvent(justwifi_radio_callback_t callback, void * context) {
+
+    _callback = callback;
+    _context = context;
+
+    if (!callback) {
+        for (uint8_t i = 0; i < 3; i++) _handlers[i] = nullptr;
+        return true;
+    }
+
+    _handlers[0] = WiFi.onStationModeConnected([this](const WiFiEventStationModeConnected &) {
+        _notify(RADIO_EVENT_CONNECTED);
+    });
+    _handlers[1] = WiFi.onStationModeGotIP([this](const WiFiEventStationModeGotIP &) {
+        _notify(RADIO_EVENT_GOT_IP);
+    });
+    _handlers[2] = WiFi.onStationModeDisconnected([this](const WiFiEventStationModeDisconnected &) {
+        _notify(RADIO_EVENT_DISCONNECTED);
+    });
+
+    return true;
+
+}
+
+//------------------------------------------------------------------------------
+// DEFAULT INSTANCE
+//------------------------------------------------------------------------------
+
+JustWifiRadio & justwifiDefaultRadio() {
+    static JustWifiESP8266Radio radio;
+    return radio;
+}
@@ -0,0 +1,189 @@
+/*
+
+JustWifi 2.0.0
+
+Wifi Manager for ESP8266
+
+Copyright (C) 2016-2018 by Xose Pérez <xose dot perez at gmail dot com>
+
+The JustWifi library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The JustWifi library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the JustWifi library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef JustWifiRadio_h
+#define JustWifiRadio_h
+
+#include <ESP8266WiFi.h>
+
+// Raw scan result, pointers are valid until the next scan or scanDelete()
+typedef struct {
+    const uint8_t * ssid;       // not null terminated
+    uint8_t ssid_len;
+    const uint8_t * bssid;
+    int8_t rssi;
+    uint8_t channel;
+    uint8_t security;           // ENC_TYPE_*
+    bool hidden;
+} justwifi_scan_result_t;
+
+// Station events reported by the backend
+typedef enum {
+    RADIO_EVENT_CONNECTED,
+    RADIO_EVENT_GOT_IP,
+    RADIO_EVENT_DISCONNECTED
+} justwifi_radio_event_t;
+
+typedef void (*justwifi_radio_callback_t)(justwifi_radio_event_t event, void * context);
+
+// -----------------------------------------------------------------------------
+// Radio backend
+// Everything the state machine needs from the WiFi stack and the system clock
+// goes through this interface, so a simulated radio (with its own clock) can
+// be plugged in to benchmark or replay connection scenarios.
+// -----------------------------------------------------------------------------
+
+class JustWifiRadio {
+
+    public:
+
+        virtual ~JustWifiRadio() {}
+
+        // System
+        virtual unsigned long millis() = 0;
+        virtual void delay(unsigned long ms) = 0;
+        virtual uint32_t chipId() = 0;
+        virtual const char * sdkVersion() = 0;
+        virtual bool rtcRead(uint32_t offset, uint32_t * data, size_t size) = 0;
+        virtual bool rtcWrite(uint32_t offset, uint32_t * data, size_t size) = 0;
+
+        // Mode
+        virtual WiFiMode_t getMode() = 0;
+        virtual bool mode(WiFiMode_t mode) = 0;
+        virtual bool enableSTA(bool enabled) = 0;
+        virtual bool enableAP(bool enabled) = 0;
+        virtual void persistent(bool persistent) = 0;
+        virtual bool forceSleepBegin() = 0;
+        virtual bool forceSleepWake() = 0;
+
+        // Station
+        virtual bool hostname(const char * hostname) = 0;
+        virtual bool config(IPAddress ip, IPAddress gw, IPAddress netmask, IPAddress dns) = 0;
+        virtual wl_status_t begin(const char * ssid, const char * pass, int32_t channel = 0, const uint8_t * bssid = NULL) = 0;
+        virtual bool disconnect() = 0;
+        virtual wl_status_t status() = 0;
+        virtual bool setAutoConnect(bool autoConnect) = 0;
+        virtual bool setAutoReconnect(bool autoReconnect) = 0;
+        virtual String SSID() = 0;
+        virtual String psk() = 0;
+        virtual uint8_t * BSSID() = 0;
+        virtual int32_t channel() = 0;
+        virtual int32_t RSSI() = 0;
+        virtual IPAddress localIP() = 0;
+        virtual IPAddress gatewayIP() = 0;
+        virtual IPAddress subnetMask() = 0;
+        virtual IPAddress dnsIP() = 0;
+
+        // Scan
+        // Channel 0 scans all channels, ssid limits the probes to that network
+        virtual int8_t scanNetworks(bool async, bool show_hidden, uint8_t channel = 0, const char * ssid = NULL) = 0;
+        virtual int8_t scanComplete() = 0;
+        virtual void scanDelete() = 0;
+        virtual bool getScanResult(uint8_t i, justwifi_scan_result_t &result) = 0;
+
+        // Soft AP
+        virtual bool softAP(const char * ssid, const char * pass = NULL) = 0;
+        virtual bool softAPConfig(IPAddress ip, IPAddress gw, IPAddress netmask) = 0;
+        virtual bool softAPdisconnect() = 0;
+
+        // SmartConfig
+        virtual bool beginSmartConfig() = 0;
+        virtual bool smartConfigDone() = 0;
+        virtual bool stopSmartConfig() = 0;
+
+        // Events, a NULL callback unregisters it. Backends without
+        // event support return false and the state machine keeps polling
+        virtual bool onEvent(justwifi_radio_callback_t, void *) { return false; }
+
+};
+
+// -----------------------------------------------------------------------------
+// Default backend, a thin wrapper around the ESP8266 WiFi singleton
+// -----------------------------------------------------------------------------
+
+class JustWifiESP8266Radio : public JustWifiRadio {
+
+    public:
+
+        unsigned long millis();
+        void delay(unsigned long ms);
+        uint32_t chipId();
+        const char * sdkVersion();
+        bool rtcRead(uint32_t offset, uint32_t * data, size_t size);
+        bool rtcWrite(uint32_t offset, uint32_t * data, size_t size);
+
+        WiFiMode_t getMode();
+        bool mode(WiFiMode_t mode);
+        bool enableSTA(bool enabled);
+        bool enableAP(bool enabled);
+        void persistent(bool persistent);
+        bool forceSleepBegin();
+        bool forceSleepWake();
+
+        bool hostname(const char * hostname);
+        bool config(IPAddress ip, IPAddress gw, IPAddress netmask, IPAddress dns);
+        wl_status_t begin(const char * ssid, const char * pass, int32_t channel = 0, const uint8_t * bssid = NULL);
+        bool disconnect();
+        wl_status_t status();
+        bool setAutoConnect(bool autoConnect);
+        bool setAutoReconnect(bool autoReconnect);
+        String SSID();
+        String psk();
+        uint8_t * BSSID();
+        int32_t channel();
+        int32_t RSSI();
+        IPAddress localIP();
+        IPAddress gatewayIP();
+        IPAddress subnetMask();
+        IPAddress dnsIP();
+
+        int8_t scanNetworks(bool async, bool show_hidden, uint8_t channel = 0, const char * ssid = NULL);
+        int8_t scanComplete();
+        void scanDelete();
+        bool getScanResult(uint8_t i, justwifi_scan_result_t &result);
+
+        bool softAP(const char * ssid, const char * pass = NULL);
+        bool softAPConfig(IPAddress ip, IPAddress gw, IPAddress netmask);
+        bool softAPdisconnect();
+
+        bool beginSmartConfig();
+        bool smartConfigDone();
+        bool stopSmartConfig();
+
+        bool onEvent(justwifi_radio_callback_t callback, void * context);
+
+    private:
+
+        justwifi_radio_callback_t _callback = NULL;
+        void * _context = NULL;
+        WiFiEventHandler _handlers[3];
+
+        void _notify(justwifi_radio_event_t event);
+
+};
+
+// Shared default instance, created on first use so it is safe to call
+// from other global constructors (like the one of the jw object)
+JustWifiRadio & justwifiDefaultRadio();
+
+#endif